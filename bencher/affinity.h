@@ -0,0 +1,156 @@
+#ifndef _AFFINITY_H
+#define _AFFINITY_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+
+#include <sys/sysinfo.h>
+
+#include "fileutils.h"
+
+#define ONLINE_CPUS "/sys/devices/system/cpu/online"
+#define THREAD_SIBLINGS "/sys/devices/system/cpu/cpu%d/topology/thread_siblings_list"
+
+// Parse a kernel style cpu list ("0,2-3") into set, returns 0 on error
+int parse_cpu_list(const char *list, cpu_set_t *set) {
+    const char *pos = list;
+    while (*pos && *pos != '\n') {
+        int first, last, read;
+        if (sscanf(pos, "%d%n", &first, &read) != 1)
+            return 0;
+        pos += read;
+
+        last = first;
+        if (*pos == '-') {
+            if (sscanf(pos + 1, "%d%n", &last, &read) != 1)
+                return 0;
+            pos += read + 1;
+        }
+
+        if (first < 0 || last < first || last >= CPU_SETSIZE)
+            return 0;
+        for (int cpu = first; cpu <= last; ++cpu)
+            CPU_SET(cpu, set);
+
+        if (*pos == ',')
+            ++pos;
+    }
+
+    return 1;
+}
+
+// Parse a cpu list from a sysfs file into set, returns 0 on error
+int read_cpu_list(const char *filename, cpu_set_t *set) {
+    char *list = read_all(filename, NULL, 0);
+    if (!list)
+        return 0;
+
+    int ok = parse_cpu_list(list, set);
+    free(list);
+    return ok;
+}
+
+// Add the first hardware thread of every physical core
+int one_per_core(cpu_set_t *set) {
+    cpu_set_t online;
+    CPU_ZERO(&online);
+    if (!read_cpu_list(ONLINE_CPUS, &online))
+        return 0;
+
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+        if (!CPU_ISSET(cpu, &online))
+            continue;
+
+        // Enough room to print any int (warns for lower numbers)
+        char filename[sizeof THREAD_SIBLINGS + 8];
+        snprintf(filename, sizeof filename, THREAD_SIBLINGS, cpu);
+
+        cpu_set_t siblings;
+        CPU_ZERO(&siblings);
+        if (!read_cpu_list(filename, &siblings))
+            return 0;
+
+        // Only add the lowest sibling
+        int first = 0;
+        while (first < CPU_SETSIZE && !CPU_ISSET(first, &siblings))
+            ++first;
+        if (first == cpu)
+            CPU_SET(cpu, set);
+    }
+
+    return 1;
+}
+
+// Parse "-cpus" argument: comma separated cpus, ranges and keywords
+//   all-smt       all online cpus, including SMT siblings
+//   one-per-core  one hardware thread per physical core
+int parse_cpus(const char *spec, cpu_set_t *set) {
+    CPU_ZERO(set);
+
+    char *copy = strdup(spec);
+    char *saveptr;
+    int ok = 1;
+    for (char *item = strtok_r(copy, ",", &saveptr); ok && item; item = strtok_r(NULL, ",", &saveptr)) {
+        if (strcmp(item, "all-smt") == 0)
+            ok = read_cpu_list(ONLINE_CPUS, set);
+        else if (strcmp(item, "one-per-core") == 0)
+            ok = one_per_core(set);
+        else
+            ok = parse_cpu_list(item, set);
+    }
+    free(copy);
+
+    if (ok && CPU_COUNT(set) == 0)
+        ok = 0;
+    if (!ok)
+        fprintf(stderr, "Error: Invalid cpu set \"%s\".\n", spec);
+    return ok;
+}
+
+// Cpus of the concurrent jobs of a campaign, inherited by the job processes
+// (defined in bencher.c)
+extern cpu_set_t campaign_cpus;
+
+// All cpus neither in set nor used by campaign jobs, for helper threads. If
+// a campaign uses all other cpus, helpers share the cpus of their own job.
+// Returns 0 if there are none.
+int other_cpus(const cpu_set_t *set, cpu_set_t *others) {
+    CPU_ZERO(others);
+    for (int cpu = 0; cpu < get_nprocs(); ++cpu)
+        if (!CPU_ISSET(cpu, set) && !CPU_ISSET(cpu, &campaign_cpus))
+            CPU_SET(cpu, others);
+
+    if (!CPU_COUNT(others) && CPU_COUNT(&campaign_cpus))
+        *others = *set;
+    return CPU_COUNT(others) > 0;
+}
+
+// Print set in cpu list format ("0,2-3")
+void format_cpus(const cpu_set_t *set, char *buffer, size_t length) {
+    size_t used = 0;
+    buffer[0] = 0;
+
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+        if (!CPU_ISSET(cpu, set))
+            continue;
+
+        int last = cpu;
+        while (last + 1 < CPU_SETSIZE && CPU_ISSET(last + 1, set))
+            ++last;
+
+        int written;
+        if (last == cpu)
+            written = snprintf(buffer + used, length - used, "%s%d", used ? "," : "", cpu);
+        else
+            written = snprintf(buffer + used, length - used, "%s%d-%d", used ? "," : "", cpu, last);
+
+        if (written < 0 || (size_t) written >= length - used)
+            break;
+        used += written;
+        cpu = last;
+    }
+}
+
+#endif // _AFFINITY_H
@@ -0,0 +1,127 @@
+// Allocation counting shim, preloaded into benchmarks by "bencher -allocstat"
+// (see allocstat.h). Forwards to the glibc allocator.
+#define _GNU_SOURCE
+#define ALLOCSTAT_SHIM
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <malloc.h>
+#include <unistd.h>
+
+#include <sys/syscall.h>
+
+#include "allocstat.h"
+
+// Entry points of glibc's malloc, which can be used without dlsym
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t count, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void *__libc_memalign(size_t alignment, size_t size);
+extern void __libc_free(void *ptr);
+
+static struct AllocReport report;
+static int64_t live;
+
+// Slot of the calling thread, initial-exec TLS does not allocate
+static __thread struct AllocThread *self __attribute__((tls_model("initial-exec")));
+static __thread int shared;
+
+static struct AllocThread *thread_slot(void) {
+	if (!self) {
+		int index = __atomic_fetch_add(&report.threads, 1, __ATOMIC_RELAXED);
+		shared = index >= ALLOC_THREADS - 1;
+		self = &report.thread[shared ? ALLOC_THREADS - 1 : index];
+		self->tid = syscall(SYS_gettid);
+	}
+	return self;
+}
+
+// Only the last slot is written by more than one thread
+static void add(int64_t *counter, int64_t value) {
+	if (shared)
+		__atomic_fetch_add(counter, value, __ATOMIC_RELAXED);
+	else
+		*counter += value;
+}
+
+static void count_malloc(void *ptr, size_t size) {
+	if (!ptr)
+		return;
+
+	struct AllocThread *thread = thread_slot();
+	add(&thread->mallocs, 1);
+	add(&thread->bytes, size);
+	add(&thread->classes[alloc_class(size)], 1);
+
+	int64_t now = __atomic_add_fetch(&live, malloc_usable_size(ptr), __ATOMIC_RELAXED);
+	int64_t peak = __atomic_load_n(&report.peak, __ATOMIC_RELAXED);
+	while (now > peak && !__atomic_compare_exchange_n(&report.peak, &peak, now, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+static void count_release(size_t usable) {
+	add(&thread_slot()->frees, 1);
+	__atomic_sub_fetch(&live, usable, __ATOMIC_RELAXED);
+}
+
+static void count_free(void *ptr) {
+	if (ptr)
+		count_release(malloc_usable_size(ptr));
+}
+
+void *malloc(size_t size) {
+	void *ptr = __libc_malloc(size);
+	count_malloc(ptr, size);
+	return ptr;
+}
+
+void *calloc(size_t count, size_t size) {
+	void *ptr = __libc_calloc(count, size);
+	count_malloc(ptr, count * size);
+	return ptr;
+}
+
+// Counted as free of the old and allocation of the new block, realloc(ptr, 0)
+// only as free. On failure, the old block stays live.
+void *realloc(void *ptr, size_t size) {
+	size_t old = ptr ? malloc_usable_size(ptr) : 0;
+	void *result = __libc_realloc(ptr, size);
+	if (ptr && (result || size == 0))
+		count_release(old);
+	count_malloc(result, size);
+	return result;
+}
+
+void free(void *ptr) {
+	count_free(ptr);
+	__libc_free(ptr);
+}
+
+void *memalign(size_t alignment, size_t size) {
+	void *ptr = __libc_memalign(alignment, size);
+	count_malloc(ptr, size);
+	return ptr;
+}
+
+void *aligned_alloc(size_t alignment, size_t size) {
+	return memalign(alignment, size);
+}
+
+int posix_memalign(void **ptr, size_t alignment, size_t size) {
+	if (alignment % sizeof(void *) || (alignment & (alignment - 1)))
+		return EINVAL;
+	*ptr = memalign(alignment, size);
+	return *ptr ? 0 : ENOMEM;
+}
+
+void *valloc(size_t size) {
+	return memalign(sysconf(_SC_PAGESIZE), size);
+}
+
+// Runs after the destructors of the benchmark, preloaded libraries are
+// initialized first and finalized last
+__attribute__((destructor)) static void write_report(void) {
+	const char *fd = getenv(ALLOCSTAT_FD);
+	if (fd && pwrite(atoi(fd), &report, sizeof report, 0) != sizeof report)
+		write(2, "allocstat: Could not write report\n", 34);
+}
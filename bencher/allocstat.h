@@ -0,0 +1,100 @@
+#ifndef _ALLOCSTAT_H
+#define _ALLOCSTAT_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Heap allocation accounting: output/allocstat.so (built from allocstat.c) is
+// preloaded into the benchmark and counts malloc and free calls, requested
+// bytes and a histogram of request sizes per thread, as well as the peak of
+// live bytes (usable size) of the whole process. At exit, it writes a
+// struct AllocReport to the file descriptor named by ALLOCSTAT_FD.
+
+#define ALLOCSTAT_FD "BENCHER_ALLOCSTAT_FD"
+#define ALLOC_THREADS 256 // Later threads share the last slot
+#define ALLOC_CLASSES 20  // <= 16 bytes, <= 32 bytes ... <= 4 MiB, larger
+
+struct AllocThread {
+    int32_t tid;
+    int64_t mallocs, frees;
+    int64_t bytes; // requested
+    int64_t classes[ALLOC_CLASSES];
+};
+
+struct AllocReport {
+    int64_t peak; // live bytes
+    int32_t threads; // -1 if there is no report
+    struct AllocThread thread[ALLOC_THREADS];
+};
+
+// Histogram bucket of a request: powers of two, starting at 16 bytes. Static,
+// so the preloaded shim does not export it to the benchmark.
+static inline int alloc_class(size_t size) {
+    int bucket = 0;
+    for (size_t limit = 16; size > limit && bucket < ALLOC_CLASSES - 1; limit *= 2)
+        ++bucket;
+    return bucket;
+}
+
+#ifndef ALLOCSTAT_SHIM
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "fileutils.h"
+
+// Add library in front of LD_PRELOAD, keeping libraries which are already
+// preloaded (in the child, before execv)
+void preload_library(const char *library) {
+    const char *preload = getenv("LD_PRELOAD");
+    if (preload && *preload) {
+        char *both = (char *) malloc(strlen(library) + strlen(preload) + 2);
+        sprintf(both, "%s:%s", library, preload);
+        setenv("LD_PRELOAD", both, 1);
+        free(both);
+    } else {
+        setenv("LD_PRELOAD", library, 1);
+    }
+}
+
+// Let the benchmark inherit fd and preload the shim (in the child, before execv)
+void allocstat_child(int fd, const char *shim) {
+    report_child(fd, ALLOCSTAT_FD);
+    preload_library(shim);
+}
+
+// Read the report after the benchmark exited, sets threads to -1 if the shim
+// did not write one (static binary or abnormal exit)
+void allocstat_read(int fd, struct AllocReport *report) {
+    if (pread(fd, report, sizeof *report, 0) != sizeof *report) {
+        static int warned;
+        if (!warned) {
+            fprintf(stderr, "Warning: No allocation report, is the benchmark dynamically linked?\n");
+            warned = 1;
+        }
+        report->threads = -1;
+    } else if (report->threads > ALLOC_THREADS) {
+        report->threads = ALLOC_THREADS;
+    }
+}
+
+// Sum over all threads
+struct AllocThread allocstat_total(const struct AllocReport *report) {
+    struct AllocThread total;
+    memset(&total, 0, sizeof total);
+    for (int i = 0; i < report->threads; ++i) {
+        const struct AllocThread *thread = &report->thread[i];
+        total.mallocs += thread->mallocs;
+        total.frees += thread->frees;
+        total.bytes += thread->bytes;
+        for (int j = 0; j < ALLOC_CLASSES; ++j)
+            total.classes[j] += thread->classes[j];
+    }
+    return total;
+}
+
+#endif // ALLOCSTAT_SHIM
+
+#endif // _ALLOCSTAT_H
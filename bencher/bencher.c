@@ -5,6 +5,8 @@
 #include <time.h>
 #include <assert.h>
 #include <sched.h>
+#include <fcntl.h>
+#include <errno.h>
 
 #include <sys/types.h>
 #include <sys/time.h>
@@ -14,12 +16,30 @@
 #include "diff.h"
 #include "fileutils.h"
 #include "cpufreq.h"
-
-#define STRINGIFY_HELPER(arg) #arg
-#define STRINGIFY(arg) STRINGIFY_HELPER(arg)
+#include "perf.h"
+#include "stats.h"
+#include "affinity.h"
+#include "stream.h"
+#include "timing.h"
+#include "sampler.h"
+#include "throttle.h"
+#include "campaign.h"
+#include "manifest.h"
+#include "json.h"
+#include "cgroup.h"
+#include "profile.h"
+#include "allocstat.h"
+#include "thp.h"
+#include "numa.h"
+#include "harness.h"
+#include "startup.h"
+#include "nprocs.h"
 
 int usage_error() {
-	fprintf(stderr, "Argument format is [-i <input-file>] [-diff <diff-file> [-abserr <absolute-error> | -bin]] [-t <timeout-secs>] <output-file> <binary> [<binary arguments>...]\n");
+	fprintf(stderr, "Argument format is [-i <input-file> [-stdin pipe|file|memfd]] [-diff <diff-file> | -digest <digest-file>] [-abserr <absolute-error> | -bin] [-stream] [-t <timeout-secs>] [-cgroup <memory-max> <cpus>] [-cpus <cpu-list> [-scale]] [-sizes <size-list>] [-perf] [-profile <frequency> <folded-file>] [-allocstat <shim> | -allocators <allocator-list>] [-thp <mode-list>] [-numa local|interleave|bind-remote|first-touch] [-harness] [-startup] [-freq <max-drift>] [-sample <interval-ms> <sample-file>] [-json <json-file>] [-meta <key>=<value>]... [-warmup <runs>] [-ci <relative-ci>] [-max-iters <runs>] [-max-time <secs>] <output-file> <binary> [<binary arguments>...]\n");
+	fprintf(stderr, "                or -mkdigest <reference-file> <digest-file>\n");
+	fprintf(stderr, "                or -campaign <job-file> [<cpu-list> [<check-jobs>]]\n");
+	fprintf(stderr, "                or -manifest <manifest-file> <cpu-list> <check-jobs> [<type>=<size>]... [<bencher options>...]\n");
 	return EXIT_FAILURE;
 }
 
@@ -28,31 +48,240 @@ struct Input {
 	char *text;
 };
 
-#define CLOCK CLOCK_MONOTONIC
+// Delivery of input to stdin of the child
+enum StdinMode {
+	STDIN_PIPE,  // written by bencher after fork
+	STDIN_FILE,  // input file opened directly
+	STDIN_MEMFD, // sealed in-memory copy of the input file
+};
+
+struct Options {
+	const char *input_file;
+	struct Input input;
+	enum StdinMode stdin_mode;
+	int input_fd;
+	const char *diff_file;
+	const char *digest_file;
+	struct Diff diff;
+	rlim_t timeout_secs;
+	struct Cgroup *cgroup;
+	cpu_set_t cpus;
+	int nprocs; // "-cpus" given, hint the thread count
+	const char *buffer;
+	int perf;
+	struct Profile *profile;
+	const char *allocstat;
+	const char *allocators;
+	const char *preload; // Allocator of the current run
+	const char *thp;     // Huge page modes
+	int thp_mode;        // Mode of the current run
+	struct Numa *numa;
+	int harness;
+	int startup;
+	int freq;
+	double max_drift;
+	int target_freq;
+	struct SampleLog *samples;
+	struct JsonLog *json;
+	int stream;
+	int scale;
+	const char *sizes;
+	const char *size; // current size of a sweep
+
+	// Iteration control
+	int warmup;
+	double ci;
+	int max_iters;
+	double max_time;
+};
+
+// Write information to file
+#define CSV_SEP "  "
+#define CSV_HEADER \
+	"total  " CSV_SEP \
+	"user   " CSV_SEP \
+	"system " CSV_SEP \
+	"maxrss " CSV_SEP \
+	"minflt " CSV_SEP \
+	"majflt " CSV_SEP \
+	"swap   " CSV_SEP \
+	"vcsw   " CSV_SEP \
+	"ivcsw  " CSV_SEP \
+	"overhead"
+#define PERF_WIDTH 13
+#define ALLOC_WIDTH 11
+
+// Whether memory per node is the peak anonymous memory of the run's cgroup,
+// instead of the pages allocated system wide
+int numa_anon(const struct Options *opts) {
+	return opts->numa && opts->cgroup && opts->cgroup->available;
+}
+
+void write_header(FILE *outfile, const struct Options *opts) {
+	fprintf(outfile, CSV_HEADER);
+
+	// "overhead" is narrower than its values
+	const char *pad = "  ";
+
+	// Time spent verifying streamed output
+	if (opts->stream) {
+		fprintf(outfile, "%s" CSV_SEP "verify ", pad);
+		pad = "";
+	}
+
+	// Frequency of the pinned cpus (MHz) and maximum temperature (degrees Celsius)
+	if (opts->freq) {
+		fprintf(outfile, "%s" CSV_SEP "minfreq" CSV_SEP "avgfreq" CSV_SEP "temp   ", pad);
+		pad = "";
+	}
+
+	// Cgroup peak memory (KiB), cpu.max throttling and pressure stall times
+	if (opts->cgroup) {
+		fprintf(outfile, "%s" CSV_SEP "cgpeak " CSV_SEP "thrott " CSV_SEP "cpupsi " CSV_SEP "mempsi " CSV_SEP "memfull", pad);
+		pad = "";
+	}
+
+	// Heap allocations: calls, requested KiB and peak of live KiB
+	if (opts->allocstat) {
+		fprintf(outfile, "%s" CSV_SEP "%-*s" CSV_SEP "%-*s" CSV_SEP "%-*s" CSV_SEP "%-*s", pad,
+			ALLOC_WIDTH, "mallocs", ALLOC_WIDTH, "frees", ALLOC_WIDTH, "allockib", ALLOC_WIDTH, "livepeak");
+		pad = "";
+	}
+
+	// Huge pages faulted in (system wide) and dTLB misses, unless counted anyway
+	if (opts->thp) {
+		fprintf(outfile, "%s" CSV_SEP "thpfault", pad);
+		if (!opts->perf)
+			fprintf(outfile, CSV_SEP "%-*s", PERF_WIDTH, perf_events[PERF_DTLB].name);
+		pad = "";
+	}
+
+	// MiB allocated on each node (system wide), or peak anonymous MiB of the
+	// run's cgroup on each node
+	if (opts->numa) {
+		fprintf(outfile, "%s", pad);
+		for (int i = 0; i < opts->numa->report_count; ++i)
+			fprintf(outfile, CSV_SEP "%s%-3d", numa_anon(opts) ? "anon" : "node", opts->numa->report[i]);
+		pad = "";
+	}
+
+	// Warm time per call of the routines measured by the in-process harness
+	if (opts->harness) {
+		fprintf(outfile, "%s" CSV_SEP "warm   ", pad);
+		pad = "";
+	}
+
+	// Exec to main (ms)
+	if (opts->startup) {
+		fprintf(outfile, "%s" CSV_SEP "startup", pad);
+		pad = "";
+	}
+
+	// Hardware counters
+	if (opts->perf) {
+		fprintf(outfile, "%s", pad);
+		for (size_t i = 0; i < PERF_EVENTS; ++i)
+			fprintf(outfile, CSV_SEP "%-*s", PERF_WIDTH, perf_events[i].name);
+	}
+
+	fprintf(outfile, "\n");
+}
+
+// Measurements of a single iteration
+struct Run {
+	struct timespec elapsed;  // exec to exit of the child
+	struct timespec overhead; // fork to exec and exit to reaping
+	struct rusage rusage;
+	struct Perf perf;
+	struct timespec verify;
+	struct Clocks clocks;
+	struct CgroupStats cgroup;
+	struct AllocReport alloc;
+	long thp_faults;
+	long long dtlb_misses;
+	long numa_pages[NUMA_REPORT];
+	struct HarnessReport harness;
+	long long startup_ns; // -1 without stamp
+};
+
+double seconds(const struct timespec *time) {
+	return time->tv_sec + time->tv_nsec / 1e9;
+}
+
 #ifndef BUFFER
 	#define BUFFER "tmp/buffer"
 #endif
-int run_bench(const struct Input *input, FILE* outfile, char** argv, rlim_t timeout_secs, const struct Diff *diff) {
+int run_bench(const struct Options *opts, char** argv, struct Run *run) {
+	const struct Input *input = &opts->input;
+	const struct Diff *diff = &opts->diff;
+	rlim_t timeout_secs = opts->timeout_secs;
 
 	// Create pipes for communication
 	#define CHILD_IN 0
 	#define PARENT_OUT 1
 	int pipes[2];
 
-	// Create first set of pipes
-	if (pipe(pipes)) {
+	// Create first set of pipes, unless input is delivered through a file descriptor
+	int use_pipe = opts->input_fd < 0;
+	if (use_pipe && pipe(pipes)) {
 		perror("pipe child -> parent");
 		exit(EXIT_FAILURE);
 	}
 
-	// Create cpu set for cpu 0
-	cpu_set_t cpu_set;
-	CPU_ZERO(&cpu_set);
-	CPU_SET(1, &cpu_set);
+	// Pipe for streamed output, read end stays in the parent
+	int output_pipe[2];
+	if (opts->stream && pipe2(output_pipe, O_CLOEXEC)) {
+		perror("pipe child -> verifier");
+		exit(EXIT_FAILURE);
+	}
 
-	// Store start time
-	struct timespec start;
-	clock_gettime(CLOCK, &start);
+	// Every child reads the input from the start
+	if (!use_pipe)
+		lseek(opts->input_fd, 0, SEEK_SET);
+
+	// Child waits for the parent to attach counters before calling execv
+	int wait_attach = opts->perf || opts->profile || opts->thp;
+	int sync[2];
+	if (wait_attach && pipe(sync)) {
+		perror("pipe parent -> child");
+		exit(EXIT_FAILURE);
+	}
+
+	// Separate cgroup for the child
+	char cgroup_path[PATH_MAX];
+	int in_cgroup = opts->cgroup && opts->cgroup->available && cgroup_create(opts->cgroup, cgroup_path, sizeof cgroup_path);
+
+	// Allocation report of the preloaded shim
+	int alloc_fd = opts->allocstat ? report_memfd("allocstat") : -1;
+
+	// Steady-state times of the in-process harness
+	int harness_fd = opts->harness ? report_memfd("harness") : -1;
+
+	// Time just before main, stamped by the benchmark
+	int startup_fd = opts->startup ? report_memfd("startup") : -1;
+
+	// Huge pages faulted in before the run. Without a cgroup of the run, the
+	// count is system wide, which includes concurrent jobs of a campaign.
+	int thp_system = opts->thp && !in_cgroup && !CPU_COUNT(&campaign_cpus);
+	long thp_faults_before = thp_system ? thp_faults() : -1;
+
+	// Pages allocated on each node before the run. Without cgroups, the
+	// counts are system wide, which includes concurrent jobs of a campaign.
+	long numa_before[NUMA_REPORT];
+	int numa_system = opts->numa && !numa_anon(opts) && !CPU_COUNT(&campaign_cpus);
+	if (numa_system)
+		numa_pages(opts->numa, numa_before);
+
+	// Child stores its exec time in a shared page
+	struct Stamps *stamps = stamps_create();
+	if (!stamps)
+		exit(EXIT_FAILURE);
+
+	// Don't let the child inherit pending output
+	fflush(NULL);
+
+	// Store fork time
+	clock_gettime(CLOCK, &stamps->fork);
 
 	// Attempt to fork/execv to run child process
 	pid_t pid = fork();
@@ -60,17 +289,53 @@ int run_bench(const struct Input *input, FILE* outfile, char** argv, rlim_t time
 		perror("fork");
 		exit(EXIT_FAILURE);
 	} else if (pid == 0) {
-		// Close wrong side of pipe
-		close(pipes[PARENT_OUT]);
+		if (use_pipe) {
+			// Close wrong side of pipe
+			close(pipes[PARENT_OUT]);
 
-		// Map pipes to stdin
-		dup2(pipes[CHILD_IN], 0);
+			// Map pipes to stdin
+			dup2(pipes[CHILD_IN], 0);
+		} else {
+			// Map seekable input file or memfd to stdin
+			dup2(opts->input_fd, 0);
+		}
 
-		// Map stdout to tmpfs
-		freopen(BUFFER, "w", stdout);
+		// Map stdout to tmpfs or to the verifier
+		if (opts->stream)
+			dup2(output_pipe[PARENT_OUT], 1);
+		else
+			freopen(opts->buffer, "w", stdout);
 
-		// Pin to cpu 0
-		sched_setaffinity(0, sizeof(cpu_set), &cpu_set);
+		// Pin to selected cpus, with "-cpus" let the program use all of them
+		sched_setaffinity(0, sizeof(opts->cpus), &opts->cpus);
+		if (opts->nprocs)
+			nprocs_child(&opts->cpus);
+
+		// Enter cgroup, or limit memory with setrlimit
+		if (in_cgroup && !cgroup_enter(cgroup_path)) {
+			perror(cgroup_path);
+			cgroup_fallback(opts->cgroup);
+		} else if (opts->cgroup && !in_cgroup) {
+			cgroup_fallback(opts->cgroup);
+		}
+
+		// Preload allocation counting or another allocator
+		if (alloc_fd >= 0)
+			allocstat_child(alloc_fd, opts->allocstat);
+		if (opts->preload)
+			preload_library(opts->preload);
+		if (harness_fd >= 0)
+			report_child(harness_fd, HARNESS_FD);
+		if (startup_fd >= 0)
+			report_child(startup_fd, STARTUP_FD);
+
+		// Force transparent huge pages on or off
+		if (opts->thp)
+			thp_child(opts->thp_mode);
+
+		// Memory placement policy
+		if (opts->numa)
+			numa_child(opts->numa);
 
 		// Set timeout
 		if (timeout_secs > 0) {
@@ -80,64 +345,172 @@ int run_bench(const struct Input *input, FILE* outfile, char** argv, rlim_t time
 			setrlimit(RLIMIT_CPU, &limit);
 		}
 
-		// Run benchmark
+		// Wait until counters are attached
+		if (wait_attach) {
+			char go;
+			close(sync[PARENT_OUT]);
+			read(sync[CHILD_IN], &go, 1);
+			close(sync[CHILD_IN]);
+		}
+
+		// Run benchmark, the timed window starts here
+		clock_gettime(CLOCK, &stamps->exec);
 		execv(argv[0], argv);
 		perror(argv[0]);
 		exit(EXIT_FAILURE);
 	}
 
-	// Close wrong side of pipe
-	close(pipes[CHILD_IN]);
+	// Notified when the child exits, before it is reaped
+	int pidfd = pidfd_open(pid);
 
-	// Write to the pipe if applicable
-	if (input)
-		write(pipes[PARENT_OUT], input->text, input->length);
+	// Sample memory and threads while the child is running
+	struct Sampler sampler;
+	int sampling = opts->samples && sampler_start(&sampler, pid, opts->samples, &stamps->exec, &opts->cpus);
 
-	// Close after writing
-	close(pipes[PARENT_OUT]);
+	// Peak memory per node of the run's cgroup
+	struct NumaWatch numa_watch;
+	int numa_watching = opts->numa && in_cgroup && numa_watch_start(&numa_watch, opts->numa, cgroup_path, &opts->cpus, run->numa_pages);
 
-	// Wait for process to end
+	// Watch for throttling while the child is running
+	struct Throttle throttle;
+	int throttling = opts->freq && throttle_start(&throttle, &opts->cpus, &run->clocks);
+
+	// Verify output while the child is running
+	struct Verifier verifier;
+	int verifying = 0;
+	if (opts->stream) {
+		close(output_pipe[PARENT_OUT]);
+		verifying = verifier_start(&verifier, output_pipe[CHILD_IN], diff, &opts->cpus);
+	}
+
+	// Attach counters and the profiler, then release the child
+	struct Perf *perf = &run->perf;
+	int profiling = 0;
+	int dtlb_fd = -1;
+	if (wait_attach) {
+		close(sync[CHILD_IN]);
+		if (opts->perf)
+			perf_open(perf, pid);
+		else if (opts->thp)
+			dtlb_fd = perf_counter(&perf_events[PERF_DTLB], pid);
+		if (opts->profile)
+			profiling = profile_open(opts->profile, pid, argv[0], &opts->cpus);
+		close(sync[PARENT_OUT]);
+	}
+
+	if (use_pipe) {
+		// Close wrong side of pipe
+		close(pipes[CHILD_IN]);
+
+		// Write to the pipe if applicable. The child is already running, time
+		// it waits for these writes is part of its measured time.
+		if (input->text)
+			write(pipes[PARENT_OUT], input->text, input->length);
+
+		// Close after writing
+		close(pipes[PARENT_OUT]);
+	}
+
+	// Wait for process to end, store exit and reaping time
 	int status;
-	struct rusage rusage;
-	wait4(pid, &status, 0, &rusage);
+	wait_exit(pidfd, &stamps->exit);
+	wait4(pid, &status, 0, &run->rusage);
+	clock_gettime(CLOCK, &stamps->reaped);
+	if (pidfd < 0)
+		stamps->exit = stamps->reaped;
+	if (sampling)
+		sampler_finish(&sampler);
+	if (throttling)
+		throttle_finish(&throttle);
+	if (numa_watching)
+		numa_watch_finish(&numa_watch);
+	if (profiling)
+		profile_finish(opts->profile);
+
+	// Collect cgroup statistics once the child is gone
+	memset(&run->cgroup, -1, sizeof run->cgroup);
+	if (in_cgroup) {
+		cgroup_collect(cgroup_path, &run->cgroup);
+		if (run->cgroup.oom_kills > 0)
+			fprintf(stderr, "Error: Out of memory (memory.max %s).\n", opts->cgroup->memory_max);
+	}
+
+	// Allocation counts written by the shim at exit
+	run->alloc.threads = -1;
+	if (alloc_fd >= 0) {
+		allocstat_read(alloc_fd, &run->alloc);
+		close(alloc_fd);
+	}
+	run->harness.count = 0;
+	if (harness_fd >= 0) {
+		harness_read(harness_fd, &run->harness);
+		close(harness_fd);
+	}
+
+	// Collect counters of the child and all of its threads
+	if (opts->perf)
+		perf_read(perf);
+	if (numa_system) {
+		numa_pages(opts->numa, run->numa_pages);
+		for (int i = 0; i < opts->numa->report_count; ++i)
+			if (run->numa_pages[i] >= 0 && numa_before[i] >= 0)
+				run->numa_pages[i] -= numa_before[i];
+			else
+				run->numa_pages[i] = -1;
+	} else if (opts->numa && !numa_watching) {
+		for (int i = 0; i < opts->numa->report_count; ++i)
+			run->numa_pages[i] = -1;
+	}
+	if (opts->thp) {
+		long faults = thp_system ? thp_faults() : -1;
+		if (in_cgroup)
+			run->thp_faults = run->cgroup.thp_faults;
+		else
+			run->thp_faults = faults >= 0 && thp_faults_before >= 0 ? faults - thp_faults_before : -1;
+		run->dtlb_misses = opts->perf ? perf->values[PERF_DTLB] : perf_value(dtlb_fd);
+	}
+
+	// Wait for streamed verification outside of the measured window
+	int result = 0;
+	if (verifying) {
+		result = verifier_finish(&verifier);
+		run->verify = verifier.cpu_time;
+	}
+
+	// Split elapsed time into the benchmark and harness overhead
+	struct timespec startup = time_diff(&stamps->exec, &stamps->fork);
+	struct timespec reaping = time_diff(&stamps->reaped, &stamps->exit);
+	run->elapsed = time_diff(&stamps->exit, &stamps->exec);
+	run->overhead = time_add(&startup, &reaping);
+
+	// Exec to main
+	struct timespec main_stamp;
+	run->startup_ns = -1;
+	if (startup_fd >= 0) {
+		if (startup_read(startup_fd, &main_stamp)) {
+			struct timespec to_main = time_diff(&main_stamp, &stamps->exec);
+			run->startup_ns = to_main.tv_sec * 1000000000ll + to_main.tv_nsec;
+		}
+		close(startup_fd);
+	}
+	stamps_free(stamps);
 
 	// Stop if the process did not exit successfully
-	if (status != EXIT_SUCCESS)
+	if (status != EXIT_SUCCESS || (opts->stream && !verifying))
 		return 0;
 
-	// Store end time
-	struct timespec elapsed;
-	clock_gettime(CLOCK, &elapsed);
-
-	// Check output and close pipe
-	FILE *output = fopen(BUFFER, "r");
-	int result = check_output(output, diff);
-	fclose(output);
+	// Check output in tmpfs
+	if (!opts->stream)
+		result = check_output_file(opts->buffer, diff);
 
 	// Don't log results on diff failure
-	if (!result)
-		return result;
-
-	// Subtract times, manually carry
-	elapsed.tv_sec -= start.tv_sec;
-	if (elapsed.tv_nsec < start.tv_nsec) {
-		elapsed.tv_nsec += 1e9;
-		--elapsed.tv_sec;
-	}
-	elapsed.tv_nsec -= start.tv_nsec;
-
-	// Write information to file
-	#define CSV_SEP "  "
-	#define CSV_HEADER \
-		"total  " CSV_SEP \
-		"user   " CSV_SEP \
-		"system " CSV_SEP \
-		"maxrss " CSV_SEP \
-		"minflt " CSV_SEP \
-		"majflt " CSV_SEP \
-		"swap   " CSV_SEP \
-		"vcsw   " CSV_SEP \
-		"ivcsw\n"
+	return result;
+}
+
+void write_run(FILE *outfile, const struct Options *opts, const struct Run *run) {
+	const struct timespec elapsed = run->elapsed;
+	const struct rusage rusage = run->rusage;
+	const struct Perf *perf = &run->perf;
 
 	char decimals[10];
 
@@ -170,91 +543,120 @@ int run_bench(const struct Input *input, FILE* outfile, char** argv, rlim_t time
 
 	// Context switches
 	assert(rusage.ru_nvcsw < 1e8 && rusage.ru_nivcsw < 1e8);
-	fprintf(outfile, "%7ld" CSV_SEP "%7ld\n", rusage.ru_nvcsw, rusage.ru_nivcsw);
+	fprintf(outfile, "%7ld" CSV_SEP "%7ld" CSV_SEP, rusage.ru_nvcsw, rusage.ru_nivcsw);
 
-	return 1;
-}
+	// Harness overhead, usually well below a millisecond
+	snprintf(decimals, 10, "%09ld", run->overhead.tv_nsec);
+	assert(run->overhead.tv_sec < 1e4);
+	fprintf(outfile, "%3ld.%.6s", run->overhead.tv_sec, decimals);
 
-int main(int argc, char** argv) {
-	// Strip first argument containing program name
-	--argc;
-	++argv;
+	// Verifier cpu time
+	if (opts->stream) {
+		snprintf(decimals, 10, "%09ld", run->verify.tv_nsec);
+		assert(run->verify.tv_sec < 1e4);
+		fprintf(outfile, CSV_SEP "%3ld.%.3s", run->verify.tv_sec, decimals);
+	}
 
-	// Need at least two args to check for "-i" "<input-file>"
-	if (argc < 2)
-		return usage_error();
+	// Frequency and temperature
+	if (opts->freq) {
+		const struct Clocks *clocks = &run->clocks;
+		if (clocks->freq_samples)
+			fprintf(outfile, CSV_SEP "%7ld" CSV_SEP "%7.0f", clocks->min_freq / 1000, clocks->avg_freq / 1000);
+		else
+			fprintf(outfile, CSV_SEP "%7s" CSV_SEP "%7s", "-", "-");
 
-	// Optional argument "<input-file>" after "-i"
-	struct Input input = { 0, NULL };
-	if (strncmp("-i", argv[0], 2) == 0) {
-		// Take "-i" and "<input-file>" from argv, read file to memory
-		input.text = read_all(argv[1], &input.length, 1);
-		argc -= 2;
-		argv += 2;
+		if (clocks->temp_samples)
+			fprintf(outfile, CSV_SEP "%7.1f", clocks->max_temp / 1000.0);
+		else
+			fprintf(outfile, CSV_SEP "%7s", "-");
 	}
 
-	// Need at least two args to check for "<diff-file>" after "-d"
-	if (argc < 2)
-		return usage_error();
+	// Cgroup statistics
+	if (opts->cgroup) {
+		const struct CgroupStats *stats = &run->cgroup;
+		if (stats->peak < 0)
+			fprintf(outfile, CSV_SEP "%7s", "-");
+		else
+			fprintf(outfile, CSV_SEP "%7ld", stats->peak);
 
-	// Optional file to diff output against and optional absolute error for numeric diff.
-	struct Diff diff = { 0, NULL, 0.0, 0 };
-	if (strncmp("-diff", argv[0], 5) == 0) {
-		// Take "-diff" and "<diff-file>" from argv, read file to memory
-		diff.text = read_all(argv[1], &diff.length, 1);
-		argc -= 2;
-		argv += 2;
+		const long long times[] = { stats->throttled_us, stats->cpu_some_us, stats->memory_some_us, stats->memory_full_us };
+		for (size_t i = 0; i < sizeof times / sizeof *times; ++i) {
+			if (times[i] < 0)
+				fprintf(outfile, CSV_SEP "%7s", "-");
+			else
+				fprintf(outfile, CSV_SEP "%7.3f", times[i] / 1e6);
+		}
+	}
 
+	// Heap allocations
+	if (opts->allocstat) {
+		if (run->alloc.threads < 0) {
+			for (int i = 0; i < 4; ++i)
+				fprintf(outfile, CSV_SEP "%*s", ALLOC_WIDTH, "-");
+		} else {
+			struct AllocThread total = allocstat_total(&run->alloc);
+			fprintf(outfile, CSV_SEP "%*lld" CSV_SEP "%*lld" CSV_SEP "%*lld" CSV_SEP "%*lld",
+				ALLOC_WIDTH, (long long) total.mallocs, ALLOC_WIDTH, (long long) total.frees,
+				ALLOC_WIDTH, (long long) total.bytes / 1024, ALLOC_WIDTH, (long long) run->alloc.peak / 1024);
+		}
+	}
 
-		// Need at least two args to check for "<absolute-error>" after "-abserr"
-		if (argc < 2)
-			return usage_error();
+	// Huge pages and dTLB misses
+	if (opts->thp) {
+		if (run->thp_faults < 0)
+			fprintf(outfile, CSV_SEP "%8s", "-");
+		else
+			fprintf(outfile, CSV_SEP "%8ld", run->thp_faults);
 
-		if (strncmp("-abserr", argv[0], 7) == 0) {
-			// Take "-abserr" and "<absolute-error>" from argv, parse long double
-			sscanf(argv[1], "%Lf", &diff.abserr);
-			argc -= 2;
-			argv += 2;
-		} else if (strncmp("-bin", argv[0], 4) == 0) {
-			diff.binary = 1;
-			argc -= 1;
-			argv += 1;
-		}
+		// Otherwise in the counter columns
+		if (!opts->perf && run->dtlb_misses < 0)
+			fprintf(outfile, CSV_SEP "%*s", PERF_WIDTH, "-");
+		else if (!opts->perf)
+			fprintf(outfile, CSV_SEP "%*lld", PERF_WIDTH, run->dtlb_misses);
 	}
 
-	// Need at least two args to check for "<timeout-secs>" after "-t"
-	if (argc < 2)
-		return usage_error();
+	// Memory allocated per node
+	if (opts->numa) {
+		for (int i = 0; i < opts->numa->report_count; ++i) {
+			if (run->numa_pages[i] < 0)
+				fprintf(outfile, CSV_SEP "%7s", "-");
+			else
+				fprintf(outfile, CSV_SEP "%7ld", run->numa_pages[i] * sysconf(_SC_PAGESIZE) >> 20);
+		}
+	}
 
-	rlim_t timeout_secs = 0;
-	if (strncmp("-t", argv[0], 7) == 0) {
-		// Take "-t" and "<timout-secs>" from argv, parse long
-		sscanf(argv[1], "%lu", &timeout_secs);
-		argc -= 2;
-		argv += 2;
+	// Warm time per call
+	if (opts->harness) {
+		long long warm = harness_warm(&run->harness);
+		if (warm < 0)
+			fprintf(outfile, CSV_SEP "%7s", "-");
+		else
+			fprintf(outfile, CSV_SEP "%7.3f", warm / 1e9);
 	}
 
-	// Need at least two args for "<output-file>" and "<binary>"
-	if (argc < 2)
-		return usage_error();
+	// Exec to main
+	if (opts->startup) {
+		if (run->startup_ns < 0)
+			fprintf(outfile, CSV_SEP "%7s", "-");
+		else
+			fprintf(outfile, CSV_SEP "%7.3f", run->startup_ns / 1e6);
+	}
 
-	// Take "<output-file>" from argv, redirect to stdout or open as append
-	FILE* outfile;
-	if (strncmp(argv[0], "-", 1) == 0) {
-		outfile = stdout;
-	} else {
-		outfile = fopen(argv[0], "a");
-		if (!outfile) {
-			perror(argv[0]);
-			return EXIT_FAILURE;
+	// Hardware counters
+	if (opts->perf) {
+		for (size_t i = 0; i < PERF_EVENTS; ++i) {
+			if (perf->values[i] < 0)
+				fprintf(outfile, CSV_SEP "%*s", PERF_WIDTH, "-");
+			else
+				fprintf(outfile, CSV_SEP "%*lld", PERF_WIDTH, perf->values[i]);
 		}
 	}
-	++argv;
 
-	// Write header for current run
-	struct cpuinfo info;
-	get_cpuinfo(&info);
+	fprintf(outfile, "\n");
+}
 
+// Describe cpus and ISA for the run header
+void describe_machine(struct cpuinfo info, char *buffer, size_t length) {
 	// Convert frequency
 	char decimals[8];
 	char *unit;
@@ -283,23 +685,1462 @@ int main(int argc, char** argv) {
 	#ifndef ISA_NAME
 		#define ISA_NAME "unknown" // ISA_NAME should be set in Makefile
 	#endif
-	fprintf(outfile, "%s (%d x %d%s %s, " ISA_NAME ")\n" CSV_HEADER, argv[0], info.count, info.overall_freq, decimals, unit);
+	snprintf(buffer, length, "%d x %d%s %s, " ISA_NAME, info.count, info.overall_freq, decimals, unit);
+}
 
-	#define NUM_ITERS 5
+// Replace every "{}" in text by size, caller has to free the result
+char *substitute(const char *text, const char *size) {
+	size_t count = 0;
+	for (const char *pos = text; (pos = strstr(pos, "{}")); pos += 2)
+		++count;
+
+	char *result = (char *) malloc(strlen(text) + count * strlen(size) + 1);
+	char *out = result;
+	const char *pos;
+	while ((pos = strstr(text, "{}"))) {
+		memcpy(out, text, pos - text);
+		out += pos - text;
+		out = stpcpy(out, size);
+		text = pos + 2;
+	}
+	strcpy(out, text);
+
+	return result;
+}
+
+// Write allocation counts as JSON members
+void write_alloc_counts(FILE *file, const struct AllocThread *counts) {
+	json_key(file, "mallocs", 0);
+	fprintf(file, "%lld", (long long) counts->mallocs);
+	json_key(file, "frees", 0);
+	fprintf(file, "%lld", (long long) counts->frees);
+	json_key(file, "bytes", 0);
+	fprintf(file, "%lld", (long long) counts->bytes);
+	json_key(file, "classes", 0);
+	for (int i = 0; i < ALLOC_CLASSES; ++i)
+		fprintf(file, "%c%lld", i ? ',' : '[', (long long) counts->classes[i]);
+	fputc(']', file);
+}
+
+// Write run as JSON record, with full precision and all rusage fields
+void write_json(const struct Options *opts, char **argv, const struct Run *run) {
+	struct JsonLog *json = opts->json;
+	FILE *file = json->file;
+	const struct rusage *rusage = &run->rusage;
+
+	// What was run where
+	fputc('{', file);
+	json_key(file, "binary", 1);
+	json_string(file, argv[0], -1);
+	json_key(file, "args", 0);
+	fputc('[', file);
+	for (int i = 1; argv[i]; ++i) {
+		if (i > 1)
+			fputc(',', file);
+		json_string(file, argv[i], -1);
+	}
+	fputc(']', file);
+	if (opts->size) {
+		json_key(file, "size", 0);
+		json_string(file, opts->size, -1);
+	}
+	if (opts->numa) {
+		json_key(file, "numa", 0);
+		json_string(file, opts->numa->applied, -1);
+		json_key(file, "numa_layout", 0);
+		json_string(file, opts->numa->layout, -1);
+	}
+	if (opts->thp) {
+		json_key(file, "thp", 0);
+		json_string(file, thp_names[opts->thp_mode], -1);
+	}
+	if (opts->allocators) {
+		json_key(file, "allocator", 0);
+		json_string(file, opts->preload ? opts->preload : "glibc", -1);
+	}
+	json_key(file, "run", 0);
+	fprintf(file, "%d", ++json->runs);
+
+	char cpus[256];
+	format_cpus(&opts->cpus, cpus, sizeof cpus);
+	json_key(file, "cpus", 0);
+	json_string(file, cpus, -1);
+	json_key(file, "isa", 0);
+	json_string(file, ISA_NAME, -1);
+	json_key(file, "machine", 0);
+	json_string(file, json->machine, -1);
+	json_key(file, "kernel", 0);
+	json_string(file, json->uts.release, -1);
+
+	// "-meta" values, "{}" is replaced by the size of a sweep
+	json_key(file, "meta", 0);
+	fputc('{', file);
+	for (int i = 0; i < json->meta_count; ++i) {
+		const char *value = strchr(json->meta[i], '=');
+		if (i > 0)
+			fputc(',', file);
+		json_string(file, json->meta[i], value - json->meta[i]);
+		fputc(':', file);
+		char *text = substitute(value + 1, opts->size ? opts->size : "{}");
+		json_string(file, text, -1);
+		free(text);
+	}
+	fputc('}', file);
+
+	// Measurements
+	json_key(file, "total_ns", 0);
+	fprintf(file, "%lld", json_ns(&run->elapsed));
+	json_key(file, "overhead_ns", 0);
+	fprintf(file, "%lld", json_ns(&run->overhead));
+	json_key(file, "utime_ns", 0);
+	fprintf(file, "%lld", json_timeval_ns(&rusage->ru_utime));
+	json_key(file, "stime_ns", 0);
+	fprintf(file, "%lld", json_timeval_ns(&rusage->ru_stime));
+
+	const char *names[] = { "maxrss", "ixrss", "idrss", "isrss", "minflt", "majflt", "nswap", "inblock", "oublock", "msgsnd", "msgrcv", "nsignals", "nvcsw", "nivcsw" };
+	const long values[] = { rusage->ru_maxrss, rusage->ru_ixrss, rusage->ru_idrss, rusage->ru_isrss, rusage->ru_minflt, rusage->ru_majflt, rusage->ru_nswap,
+		rusage->ru_inblock, rusage->ru_oublock, rusage->ru_msgsnd, rusage->ru_msgrcv, rusage->ru_nsignals, rusage->ru_nvcsw, rusage->ru_nivcsw };
+	for (size_t i = 0; i < sizeof names / sizeof *names; ++i) {
+		json_key(file, names[i], 0);
+		fprintf(file, "%ld", values[i]);
+	}
+
+	if (opts->stream) {
+		json_key(file, "verify_ns", 0);
+		fprintf(file, "%lld", json_ns(&run->verify));
+	}
+
+	if (opts->freq) {
+		const struct Clocks *clocks = &run->clocks;
+		json_key(file, "min_freq_khz", 0);
+		fprintf(file, clocks->freq_samples ? "%ld" : "null", clocks->min_freq);
+		json_key(file, "avg_freq_khz", 0);
+		fprintf(file, clocks->freq_samples ? "%.0f" : "null", clocks->avg_freq);
+		json_key(file, "max_temp_mc", 0);
+		fprintf(file, clocks->temp_samples ? "%ld" : "null", clocks->max_temp);
+	}
+
+	if (opts->cgroup) {
+		const struct CgroupStats *stats = &run->cgroup;
+		const char *names[] = { "cgroup_peak", "throttled_ns", "cpu_some_ns", "memory_some_ns", "memory_full_ns", "oom_kills" };
+		const long long values[] = { stats->peak, stats->throttled_us * 1000, stats->cpu_some_us * 1000,
+			stats->memory_some_us * 1000, stats->memory_full_us * 1000, stats->oom_kills };
+		for (size_t i = 0; i < sizeof names / sizeof *names; ++i) {
+			json_key(file, names[i], 0);
+			fprintf(file, values[i] < 0 ? "null" : "%lld", values[i]);
+		}
+	}
+
+	// Totals and per thread counts with size class histogram
+	if (opts->allocstat && run->alloc.threads >= 0) {
+		struct AllocThread total = allocstat_total(&run->alloc);
+		json_key(file, "alloc", 0);
+		fputc('{', file);
+		json_key(file, "peak", 1);
+		fprintf(file, "%lld", (long long) run->alloc.peak);
+		write_alloc_counts(file, &total);
+		json_key(file, "threads", 0);
+		fputc('[', file);
+		for (int i = 0; i < run->alloc.threads; ++i) {
+			const struct AllocThread *thread = &run->alloc.thread[i];
+			fputs(i ? ",{" : "{", file);
+			json_key(file, "tid", 1);
+			fprintf(file, "%d", thread->tid);
+			write_alloc_counts(file, thread);
+			fputc('}', file);
+		}
+		fputs("]}", file);
+	}
+
+	if (opts->harness) {
+		json_key(file, "harness", 0);
+		fputc('[', file);
+		for (int i = 0; i < run->harness.count; ++i) {
+			const struct HarnessRoutine *routine = &run->harness.routines[i];
+			fputs(i ? ",{" : "{", file);
+			json_key(file, "name", 1);
+			json_string(file, routine->name, -1);
+			json_key(file, "calls", 0);
+			fprintf(file, "%ld", routine->calls);
+			json_key(file, "first_ns", 0);
+			fprintf(file, "%lld", routine->first_ns);
+			json_key(file, "median_ns", 0);
+			fprintf(file, "%lld", routine->median_ns);
+			json_key(file, "min_ns", 0);
+			fprintf(file, "%lld", routine->min_ns);
+			fputc('}', file);
+		}
+		fputc(']', file);
+	}
+
+	if (opts->startup) {
+		json_key(file, "startup_ns", 0);
+		fprintf(file, run->startup_ns < 0 ? "null" : "%lld", run->startup_ns);
+	}
+
+	if (opts->numa) {
+		json_key(file, numa_anon(opts) ? "node_anon_peak" : "node_pages", 0);
+		fputc('{', file);
+		for (int i = 0; i < opts->numa->report_count; ++i) {
+			char node[12];
+			snprintf(node, sizeof node, "%d", opts->numa->report[i]);
+			json_key(file, node, i == 0);
+			fprintf(file, run->numa_pages[i] < 0 ? "null" : "%ld", run->numa_pages[i]);
+		}
+		fputc('}', file);
+	}
+
+	if (opts->thp) {
+		json_key(file, "thp_faults", 0);
+		fprintf(file, run->thp_faults < 0 ? "null" : "%ld", run->thp_faults);
+		if (!opts->perf) {
+			json_key(file, perf_events[PERF_DTLB].name, 0);
+			fprintf(file, run->dtlb_misses < 0 ? "null" : "%lld", run->dtlb_misses);
+		}
+	}
+
+	if (opts->perf) {
+		for (size_t i = 0; i < PERF_EVENTS; ++i) {
+			json_key(file, perf_events[i].name, 0);
+			fprintf(file, run->perf.values[i] < 0 ? "null" : "%lld", run->perf.values[i]);
+		}
+	}
+
+	fprintf(file, "}\n");
+}
+
+// Write header for current run
+void write_title(FILE *outfile, const struct Options *opts, const char *binary, const char *machine) {
+	char cpus[256];
+	format_cpus(&opts->cpus, cpus, sizeof cpus);
+	if (opts->numa)
+		fprintf(outfile, "%s (%s, cpus %s, numa %s, nodes %s)\n", binary, machine, cpus, opts->numa->applied, opts->numa->layout);
+	else
+		fprintf(outfile, "%s (%s, cpus %s)\n", binary, machine, cpus);
+	write_header(outfile, opts);
+
+	// Samples get the same title
+	if (opts->samples) {
+		char title[512];
+		snprintf(title, sizeof title, "%s (%s, cpus %s)", binary, machine, cpus);
+		sample_title(opts->samples, title);
+	}
+}
+
+// Medians over the timing iterations
+struct Summary {
+	int count;
+	double total;
+	double maxrss;
+	double dtlb_misses; // -1 if not counted in every run
+};
+
+// Whether the average frequency of a run is off by more than "-freq" allows
+int frequency_drifted(const struct Options *opts, const struct Run *run) {
+	const struct Clocks *clocks = &run->clocks;
+	if (opts->max_drift <= 0 || !clocks->freq_samples || opts->target_freq <= 0)
+		return 0;
+
+	double drift = fabs(clocks->avg_freq - opts->target_freq) / opts->target_freq;
+	if (drift <= opts->max_drift)
+		return 0;
 
-	const char *num_iters_str = STRINGIFY(NUM_ITERS);
-	const int num_iters_len = strlen(num_iters_str);
+	fprintf(stderr, "Warning: Discarding run at %.0f MHz average (target %d MHz).\n", clocks->avg_freq / 1000, opts->target_freq / 1000);
+	return 1;
+}
+
+// Run warm-up and timing iterations
+void bench(const struct Options *opts, FILE *outfile, char **argv, struct Summary *summary) {
+	char num_iters_str[12];
+	const int num_iters_len = snprintf(num_iters_str, sizeof num_iters_str, "%d", opts->max_iters);
+
+	// Discarded warm-up iterations, output is still checked
+	struct Run run;
+	int ok = 1;
+	for (int i = 0; ok && i < opts->warmup; ++i) {
+		if (outfile != stdout)
+			printf("Warm-up %d/%d\n", i + 1, opts->warmup);
+		ok = run_bench(opts, argv, &run);
+	}
+
+	// Store start time of timing iterations for time budget
+	struct timespec start, now;
+	clock_gettime(CLOCK, &start);
 
-	// Run five timing iterations
-	for (int i = 0; i < NUM_ITERS; ++i) {
+	double *totals = (double *) malloc(sizeof(double) * opts->max_iters);
+	double *maxrss = (double *) malloc(sizeof(double) * opts->max_iters);
+	double *dtlb_misses = (double *) malloc(sizeof(double) * opts->max_iters);
+	int count = 0;
+	double rel_ci = INFINITY;
+	int rejected = 0;
+
+	// Run timing iterations
+	for (int i = 0; ok && i < opts->max_iters; ++i) {
 		if (outfile != stdout)
 			printf("Iteration %0*d/%s\n", num_iters_len, i + 1, num_iters_str);
-		if (!run_bench(&input, outfile, argv, timeout_secs, &diff))
+		if (!run_bench(opts, argv, &run))
+			break;
+
+		// Repeat iterations which ran at the wrong frequency
+		if (frequency_drifted(opts, &run)) {
+			if (++rejected > opts->max_iters) {
+				fprintf(stderr, "Error: Too many iterations with drifted frequency.\n");
+				break;
+			}
+
+			// Only repeat within the time budget
+			clock_gettime(CLOCK, &now);
+			if (opts->max_time > 0 && seconds(&now) - seconds(&start) >= opts->max_time)
+				break;
+			--i;
+			continue;
+		}
+
+		write_run(outfile, opts, &run);
+		if (opts->json)
+			write_json(opts, argv, &run);
+		maxrss[count] = run.rusage.ru_maxrss;
+		dtlb_misses[count] = opts->thp ? run.dtlb_misses : opts->perf ? run.perf.values[PERF_DTLB] : -1;
+		totals[count++] = seconds(&run.elapsed);
+
+		// Stop when the median is known precisely enough
+		if (opts->ci > 0) {
+			double *sorted = sorted_copy(totals, count);
+			rel_ci = median_rel_ci(sorted, count);
+			free(sorted);
+
+			if (rel_ci <= opts->ci)
+				break;
+		}
+
+		// Stop when out of time
+		clock_gettime(CLOCK, &now);
+		if (opts->max_time > 0 && seconds(&now) - seconds(&start) >= opts->max_time)
+			break;
+	}
+
+	summary->count = count;
+
+	double *sorted = sorted_copy(totals, count);
+	summary->total = median(sorted, count);
+	if (opts->ci > 0 && count > 0 && outfile != stdout)
+		printf("Median %.3fs +- %.2f%% after %d iterations\n", summary->total, rel_ci * 100, count);
+	free(sorted);
+
+	sorted = sorted_copy(maxrss, count);
+	summary->maxrss = median(sorted, count);
+	free(sorted);
+
+	sorted = sorted_copy(dtlb_misses, count);
+	summary->dtlb_misses = count > 0 && sorted[0] >= 0 ? median(sorted, count) : -1;
+	free(sorted);
+
+	free(totals);
+	free(maxrss);
+	free(dtlb_misses);
+}
+
+// Run on 1, 2, 4 ... cpus of the selected set, then write a table of
+// speedup and parallel efficiency relative to the single cpu run
+void scale_bench(const struct Options *opts, FILE *outfile, char **argv, const char *machine) {
+	struct Options step = *opts;
+	int total = CPU_COUNT(&opts->cpus);
+
+	int *cores = (int *) malloc(sizeof(int) * total);
+	double *medians = (double *) malloc(sizeof(double) * total);
+	int steps = 0;
+
+	int count = 1;
+	while (1) {
+		// Take the lowest count cpus of the set
+		CPU_ZERO(&step.cpus);
+		for (int cpu = 0; CPU_COUNT(&step.cpus) < count; ++cpu)
+			if (CPU_ISSET(cpu, &opts->cpus))
+				CPU_SET(cpu, &step.cpus);
+
+		if (outfile != stdout)
+			printf("Scaling %d/%d cpus\n", count, total);
+		write_title(outfile, &step, argv[0], machine);
+
+		struct Summary summary;
+		bench(&step, outfile, argv, &summary);
+		if (!summary.count)
+			break;
+
+		cores[steps] = count;
+		medians[steps++] = summary.total;
+
+		// Powers of two, finish with the full set
+		if (count == total)
 			break;
+		count = count * 2 < total ? count * 2 : total;
+	}
+
+	fprintf(outfile, "%s scaling (median total)\n", argv[0]);
+	fprintf(outfile, "cpus   " CSV_SEP "median " CSV_SEP "speedup" CSV_SEP "efficiency\n");
+	for (int i = 0; i < steps; ++i) {
+		double speedup = medians[0] / medians[i];
+		fprintf(outfile, "%7d" CSV_SEP "%7.3f" CSV_SEP "%7.3f" CSV_SEP "%7.3f\n", cores[i], medians[i], speedup, speedup / cores[i]);
+	}
+
+	free(cores);
+	free(medians);
+}
+
+// Read input and diff files (with "{}" replaced by size), unless they are
+// resident. Returns 0 on error.
+int load_files(struct Options *opts, const char *size) {
+	if (opts->input_file) {
+		char *filename = substitute(opts->input_file, size);
+		opts->input_fd = opts->stdin_mode == STDIN_PIPE ? -1 : resident_fd(filename);
+		if (opts->input_fd >= 0) {
+			// Generated input, shared by all jobs of a manifest
+		} else if (opts->stdin_mode == STDIN_FILE) {
+			opts->input_fd = open(filename, O_RDONLY | O_CLOEXEC);
+			if (opts->input_fd < 0)
+				perror(filename);
+		} else {
+			opts->input.text = resident_text(filename, &opts->input.length);
+			if (!opts->input.text)
+				opts->input.text = map_file(filename, &opts->input.length);
+			if (opts->input.text && opts->stdin_mode == STDIN_MEMFD) {
+				opts->input_fd = sealed_memfd(filename, opts->input.text, opts->input.length);
+				release_text(opts->input.text, opts->input.length);
+				opts->input.text = NULL;
+			}
+		}
+		free(filename);
+
+		if (!opts->input.text && opts->input_fd < 0)
+			return 0;
 	}
 
-	free(input.text);
-	free(diff.text);
+	if (opts->digest_file) {
+		char *filename = substitute(opts->digest_file, size);
+		opts->diff.digest = resident_digest(filename);
+		if (!opts->diff.digest)
+			opts->diff.digest = digest_load(filename);
+		free(filename);
+		if (!opts->diff.digest)
+			return 0;
 
+		// Numeric diff needs the text of the reference
+		if (opts->diff.abserr != 0) {
+			opts->diff.text = map_file(opts->diff.digest->reference, &opts->diff.length);
+			release_digest(opts->diff.digest);
+			opts->diff.digest = NULL;
+			if (!opts->diff.text)
+				return 0;
+		}
+	}
+
+	if (opts->diff_file) {
+		char *filename = substitute(opts->diff_file, size);
+		opts->diff.text = resident_text(filename, &opts->diff.length);
+		if (!opts->diff.text)
+			opts->diff.text = map_file(filename, &opts->diff.length);
+		free(filename);
+		if (!opts->diff.text)
+			return 0;
+	}
+
+	return 1;
+}
+
+void free_files(struct Options *opts) {
+	release_text(opts->input.text, opts->input.length);
+	opts->input.text = NULL;
+	if (opts->input_fd >= 0)
+		close(opts->input_fd);
+	opts->input_fd = -1;
+	release_text(opts->diff.text, opts->diff.length);
+	opts->diff.text = NULL;
+	release_digest(opts->diff.digest);
+	opts->diff.digest = NULL;
+}
+
+// Run for every size in the comma separated list, replacing "{}" in files and
+// arguments. Then write a table of time and memory against size, including
+// local growth exponents and a least squares fit over all sizes.
+void size_bench(const struct Options *opts, FILE *outfile, char **argv, const char *machine) {
+	struct Options step = *opts;
+
+	int argc = 0;
+	while (argv[argc])
+		++argc;
+	char **args = (char **) calloc(argc + 1, sizeof(char *));
+
+	char *sizes = strdup(opts->sizes);
+	int max_steps = 1;
+	for (char *pos = sizes; *pos; ++pos)
+		max_steps += *pos == ',';
+
+	char **names = (char **) malloc(sizeof(char *) * max_steps);
+	struct Summary *results = (struct Summary *) malloc(sizeof(struct Summary) * max_steps);
+	int steps = 0;
+
+	char *saveptr;
+	for (char *size = strtok_r(sizes, ",", &saveptr); size; size = strtok_r(NULL, ",", &saveptr)) {
+		if (outfile != stdout)
+			printf("Size %s\n", size);
+
+		for (int i = 0; i < argc; ++i)
+			args[i] = substitute(argv[i], size);
+
+		step.size = size;
+		if (load_files(&step, size)) {
+			char label[512];
+			snprintf(label, sizeof label, "%s, size %s", args[0], size);
+			write_title(outfile, &step, label, machine);
+
+			bench(&step, outfile, args, &results[steps]);
+			if (results[steps].count)
+				names[steps++] = size;
+		}
+
+		free_files(&step);
+		for (int i = 0; i < argc; ++i)
+			free(args[i]);
+	}
+
+	fprintf(outfile, "%s size sweep (medians)\n", argv[0]);
+	fprintf(outfile, "size     " CSV_SEP "total  " CSV_SEP "maxrss " CSV_SEP "exp-t  " CSV_SEP "exp-rss\n");
+
+	// Least squares fit of log-log data
+	double sx = 0, sy = 0, sr = 0, sxx = 0, sxy = 0, sxr = 0;
+	for (int i = 0; i < steps; ++i) {
+		double x = log(atof(names[i])), y = log(results[i].total), r = log(results[i].maxrss);
+		sx += x; sy += y; sr += r;
+		sxx += x * x; sxy += x * y; sxr += x * r;
+
+		fprintf(outfile, "%9s" CSV_SEP "%7.3f" CSV_SEP "%7.0f", names[i], results[i].total, results[i].maxrss);
+		if (i == 0) {
+			fprintf(outfile, CSV_SEP "%7s" CSV_SEP "%7s\n", "-", "-");
+		} else {
+			double dx = x - log(atof(names[i - 1]));
+			fprintf(outfile, CSV_SEP "%7.3f" CSV_SEP "%7.3f\n",
+				(y - log(results[i - 1].total)) / dx, (r - log(results[i - 1].maxrss)) / dx);
+		}
+	}
+
+	double denominator = steps * sxx - sx * sx;
+	if (steps > 1 && denominator != 0)
+		fprintf(outfile, "fit      " CSV_SEP "%7s" CSV_SEP "%7s" CSV_SEP "%7.3f" CSV_SEP "%7.3f\n", "-", "-",
+			(steps * sxy - sx * sy) / denominator, (steps * sxr - sx * sr) / denominator);
+
+	free(results);
+	free(names);
+	free(sizes);
+	free(args);
+}
+
+// Run with every allocator of the comma separated list, "glibc" for the
+// default or a library to preload. Then write a table of time and memory
+// relative to the first allocator.
+void alloc_bench(const struct Options *opts, FILE *outfile, char **argv, const char *machine) {
+	struct Options step = *opts;
+
+	char *allocators = strdup(opts->allocators);
+	int max_steps = 1;
+	for (char *pos = allocators; *pos; ++pos)
+		max_steps += *pos == ',';
+
+	char **names = (char **) malloc(sizeof(char *) * max_steps);
+	struct Summary *results = (struct Summary *) malloc(sizeof(struct Summary) * max_steps);
+	int steps = 0;
+
+	char *saveptr;
+	for (char *allocator = strtok_r(allocators, ",", &saveptr); allocator; allocator = strtok_r(NULL, ",", &saveptr)) {
+		// Name of a library is its file name without ".so"
+		char *name = strrchr(allocator, '/');
+		name = name ? name + 1 : allocator;
+		step.preload = strcmp(allocator, "glibc") ? allocator : NULL;
+
+		if (outfile != stdout)
+			printf("Allocator %s\n", name);
+
+		char label[512];
+		snprintf(label, sizeof label, "%s, allocator %.*s", argv[0], (int) strcspn(name, "."), name);
+		write_title(outfile, &step, label, machine);
+
+		bench(&step, outfile, argv, &results[steps]);
+		if (results[steps].count) {
+			name[strcspn(name, ".")] = 0;
+			names[steps++] = name;
+		}
+	}
+
+	fprintf(outfile, "%s allocators (medians)\n", argv[0]);
+	fprintf(outfile, "allocator" CSV_SEP "total  " CSV_SEP "maxrss " CSV_SEP "time   " CSV_SEP "memory\n");
+	for (int i = 0; i < steps; ++i)
+		fprintf(outfile, "%-9s" CSV_SEP "%7.3f" CSV_SEP "%7.0f" CSV_SEP "%7.3f" CSV_SEP "%7.3f\n", names[i], results[i].total,
+			results[i].maxrss, results[i].total / results[0].total, results[i].maxrss / results[0].maxrss);
+
+	free(results);
+	free(names);
+	free(allocators);
+}
+
+// Run with every huge page mode of the comma separated list, then write a
+// table of time and dTLB misses relative to the first mode
+void thp_bench(const struct Options *opts, FILE *outfile, char **argv, const char *machine) {
+	struct Options step = *opts;
+
+	char *modes = strdup(opts->thp);
+	int max_steps = 1;
+	for (char *pos = modes; *pos; ++pos)
+		max_steps += *pos == ',';
+
+	int *names = (int *) malloc(sizeof(int) * max_steps);
+	struct Summary *results = (struct Summary *) malloc(sizeof(struct Summary) * max_steps);
+	int steps = 0;
+
+	char *saveptr;
+	for (char *mode = strtok_r(modes, ",", &saveptr); mode; mode = strtok_r(NULL, ",", &saveptr)) {
+		step.thp_mode = thp_mode(mode);
+		if (outfile != stdout)
+			printf("Huge pages %s\n", mode);
+
+		char label[512];
+		snprintf(label, sizeof label, "%s, huge pages %s", argv[0], mode);
+		write_title(outfile, &step, label, machine);
+
+		bench(&step, outfile, argv, &results[steps]);
+		if (results[steps].count)
+			names[steps++] = step.thp_mode;
+	}
+
+	fprintf(outfile, "%s huge pages (medians)\n", argv[0]);
+	fprintf(outfile, "thp    " CSV_SEP "total  " CSV_SEP "maxrss " CSV_SEP "%-*s" CSV_SEP "time   " CSV_SEP "dtlb\n", PERF_WIDTH, "dtlbmiss");
+	for (int i = 0; i < steps; ++i) {
+		fprintf(outfile, "%-7s" CSV_SEP "%7.3f" CSV_SEP "%7.0f", thp_names[names[i]], results[i].total, results[i].maxrss);
+		if (results[i].dtlb_misses < 0)
+			fprintf(outfile, CSV_SEP "%*s" CSV_SEP "%7.3f" CSV_SEP "%7s\n", PERF_WIDTH, "-", results[i].total / results[0].total, "-");
+		else
+			fprintf(outfile, CSV_SEP "%*.0f" CSV_SEP "%7.3f" CSV_SEP "%7.3f\n", PERF_WIDTH, results[i].dtlb_misses,
+				results[i].total / results[0].total, results[0].dtlb_misses > 0 ? results[i].dtlb_misses / results[0].dtlb_misses : 1.0);
+	}
+
+	free(results);
+	free(names);
+	free(modes);
+}
+
+// Cpus of the concurrent jobs while a campaign runs them, empty otherwise
+cpu_set_t campaign_cpus;
+
+// Overrides for jobs of a campaign
+struct Placement {
+	int cpu;
+	const char *buffer;
+	int check;           // Interference check, results are discarded
+};
+
+// File to append results of an option to, /dev/null for interference checks
+const char *result_file(const struct Placement *placement, const char *filename) {
+	return placement && placement->check ? "/dev/null" : filename;
+}
+
+// Parse options and run the benchmark. With placement, the job is pinned to a
+// single cpu and progress output is suppressed. Stores the median total if
+// median is not NULL and a single benchmark was run.
+int bench_args(int argc, char **argv, const struct Placement *placement, double *median) {
+	struct Options opts = {
+		.input_file = NULL,
+		.input = { 0, NULL },
+		.stdin_mode = STDIN_PIPE,
+		.input_fd = -1,
+		.diff_file = NULL,
+		.digest_file = NULL,
+		.diff = { 0, NULL, 0.0, 0, NULL },
+		.timeout_secs = 0,
+		.cgroup = NULL,
+		.nprocs = 0,
+		.buffer = BUFFER,
+		.perf = 0,
+		.profile = NULL,
+		.allocstat = NULL,
+		.allocators = NULL,
+		.preload = NULL,
+		.thp = NULL,
+		.thp_mode = THP_DEFAULT,
+		.numa = NULL,
+		.harness = 0,
+		.startup = 0,
+		.freq = 0,
+		.max_drift = 0.0,
+		.target_freq = 0,
+		.samples = NULL,
+		.json = NULL,
+		.stream = 0,
+		.scale = 0,
+		.sizes = NULL,
+		.size = NULL,
+		.warmup = 0,
+		.ci = 0.0,
+		.max_iters = 0,
+		.max_time = 0.0,
+	};
+
+	// Written by the sampler thread of each run
+	struct SampleLog samples = { NULL, 0, 0 };
+
+	// Parent of the per run cgroups
+	struct Cgroup cgroup;
+	memset(&cgroup, 0, sizeof cgroup);
+
+	// Structured results and their metadata
+	struct JsonLog json;
+	memset(&json, 0, sizeof json);
+
+	// Folded stacks, summed over all runs
+	struct Profile profile;
+	memset(&profile, 0, sizeof profile);
+
+	// Memory placement, resolved after the cpus
+	struct Numa numa;
+	int numa_policy_id = -1;
+
+	// Pin to cpu 1 by default
+	CPU_ZERO(&opts.cpus);
+	CPU_SET(1, &opts.cpus);
+
+	// Options precede "<output-file>", which may be "-"
+	while (argc > 0 && argv[0][0] == '-' && argv[0][1] != 0) {
+		// Need at least two args for any option followed by "<output-file>" and "<binary>"
+		if (argc < 3)
+			return usage_error();
+
+		if (strcmp("-i", argv[0]) == 0) {
+			// Take "-i" and "<input-file>" from argv, read later
+			opts.input_file = argv[1];
+			argc -= 2;
+			argv += 2;
+		} else if (strcmp("-stdin", argv[0]) == 0) {
+			// Take "-stdin" and "<mode>" from argv
+			if (strcmp("pipe", argv[1]) == 0)
+				opts.stdin_mode = STDIN_PIPE;
+			else if (strcmp("file", argv[1]) == 0)
+				opts.stdin_mode = STDIN_FILE;
+			else if (strcmp("memfd", argv[1]) == 0)
+				opts.stdin_mode = STDIN_MEMFD;
+			else
+				return usage_error();
+			argc -= 2;
+			argv += 2;
+		} else if (strcmp("-diff", argv[0]) == 0) {
+			// Take "-diff" and "<diff-file>" from argv, read later
+			opts.diff_file = argv[1];
+			argc -= 2;
+			argv += 2;
+		} else if (strcmp("-digest", argv[0]) == 0) {
+			// Take "-digest" and "<digest-file>" from argv, read later
+			opts.digest_file = argv[1];
+			argc -= 2;
+			argv += 2;
+		} else if (strcmp("-abserr", argv[0]) == 0) {
+			// Take "-abserr" and "<absolute-error>" from argv, parse long double
+			sscanf(argv[1], "%Lf", &opts.diff.abserr);
+			argc -= 2;
+			argv += 2;
+		} else if (strcmp("-bin", argv[0]) == 0) {
+			opts.diff.binary = 1;
+			argc -= 1;
+			argv += 1;
+		} else if (strcmp("-stream", argv[0]) == 0) {
+			opts.stream = 1;
+			argc -= 1;
+			argv += 1;
+		} else if (strcmp("-t", argv[0]) == 0) {
+			// Take "-t" and "<timout-secs>" from argv, parse long
+			sscanf(argv[1], "%lu", &opts.timeout_secs);
+			argc -= 2;
+			argv += 2;
+		} else if (strcmp("-cgroup", argv[0]) == 0) {
+			// Take "-cgroup", "<memory-max>" and "<cpus>" from argv, set up later
+			if (argc < 4)
+				return usage_error();
+			cgroup.memory_max = argv[1];
+			cgroup_cpu_max(&cgroup, argv[2]);
+			opts.cgroup = &cgroup;
+			argc -= 3;
+			argv += 3;
+		} else if (strcmp("-cpus", argv[0]) == 0) {
+			// Take "-cpus" and "<cpu-list>" from argv, parse cpu set
+			if (!parse_cpus(argv[1], &opts.cpus))
+				return usage_error();
+			opts.nprocs = 1;
+			nprocs_check();
+			argc -= 2;
+			argv += 2;
+		} else if (strcmp("-startup", argv[0]) == 0) {
+			opts.startup = 1;
+			argc -= 1;
+			argv += 1;
+		} else if (strcmp("-harness", argv[0]) == 0) {
+			opts.harness = 1;
+			argc -= 1;
+			argv += 1;
+		} else if (strcmp("-perf", argv[0]) == 0) {
+			opts.perf = 1;
+			argc -= 1;
+			argv += 1;
+		} else if (strcmp("-profile", argv[0]) == 0) {
+			// Take "-profile", "<frequency>" and "<folded-file>" from argv, open as append
+			if (argc < 4)
+				return usage_error();
+			profile.file = fopen(result_file(placement, argv[2]), "a");
+			if (!profile.file) {
+				perror(argv[2]);
+				return EXIT_FAILURE;
+			}
+			sscanf(argv[1], "%d", &profile.frequency);
+			opts.profile = &profile;
+			argc -= 3;
+			argv += 3;
+		} else if (strcmp("-allocstat", argv[0]) == 0) {
+			// Take "-allocstat" and "<shim>" from argv
+			if (argc < 4)
+				return usage_error();
+			opts.allocstat = argv[1];
+			argc -= 2;
+			argv += 2;
+		} else if (strcmp("-allocators", argv[0]) == 0) {
+			// Take "-allocators" and "<allocator-list>" from argv
+			if (argc < 4)
+				return usage_error();
+			opts.allocators = argv[1];
+			argc -= 2;
+			argv += 2;
+		} else if (strcmp("-thp", argv[0]) == 0) {
+			// Take "-thp" and "<mode-list>" from argv, check modes
+			char *modes = strdup(argv[1]), *saveptr;
+			for (char *mode = strtok_r(modes, ",", &saveptr); mode; mode = strtok_r(NULL, ",", &saveptr)) {
+				opts.thp_mode = thp_mode(mode);
+				if (opts.thp_mode < 0)
+					break;
+				if (opts.thp_mode == THP_ON)
+					thp_check();
+			}
+			free(modes);
+			if (opts.thp_mode < 0)
+				return usage_error();
+			opts.thp = argv[1];
+			argc -= 2;
+			argv += 2;
+		} else if (strcmp("-numa", argv[0]) == 0) {
+			// Take "-numa" and "<policy>" from argv, resolved once cpus are known
+			numa_policy_id = numa_policy(argv[1]);
+			if (numa_policy_id < 0)
+				return usage_error();
+			opts.numa = &numa;
+			argc -= 2;
+			argv += 2;
+		} else if (strcmp("-freq", argv[0]) == 0) {
+			// Take "-freq" and "<max-drift>" from argv, parse double (0 only records)
+			opts.freq = 1;
+			sscanf(argv[1], "%lf", &opts.max_drift);
+			argc -= 2;
+			argv += 2;
+		} else if (strcmp("-sample", argv[0]) == 0) {
+			// Take "-sample", "<interval-ms>" and "<sample-file>" from argv, open as append
+			if (argc < 4)
+				return usage_error();
+			samples.file = fopen(result_file(placement, argv[2]), "a");
+			if (!samples.file) {
+				perror(argv[2]);
+				return EXIT_FAILURE;
+			}
+			sscanf(argv[1], "%d", &samples.interval_ms);
+			opts.samples = &samples;
+			argc -= 3;
+			argv += 3;
+		} else if (strcmp("-json", argv[0]) == 0) {
+			// Take "-json" and "<json-file>" from argv, open as append
+			json.file = fopen(result_file(placement, argv[1]), "a");
+			if (!json.file) {
+				perror(argv[1]);
+				return EXIT_FAILURE;
+			}
+			uname(&json.uts);
+			opts.json = &json;
+			argc -= 2;
+			argv += 2;
+		} else if (strcmp("-meta", argv[0]) == 0) {
+			// Take "-meta" and "<key>=<value>" from argv
+			if (!strchr(argv[1], '=') || json.meta_count == JSON_META)
+				return usage_error();
+			json.meta[json.meta_count++] = argv[1];
+			argc -= 2;
+			argv += 2;
+		} else if (strcmp("-scale", argv[0]) == 0) {
+			opts.scale = 1;
+			argc -= 1;
+			argv += 1;
+		} else if (strcmp("-sizes", argv[0]) == 0) {
+			// Take "-sizes" and "<size-list>" from argv
+			opts.sizes = argv[1];
+			argc -= 2;
+			argv += 2;
+		} else if (strcmp("-warmup", argv[0]) == 0) {
+			// Take "-warmup" and "<runs>" from argv, parse int
+			sscanf(argv[1], "%d", &opts.warmup);
+			argc -= 2;
+			argv += 2;
+		} else if (strcmp("-ci", argv[0]) == 0) {
+			// Take "-ci" and "<relative-ci>" from argv, parse double
+			sscanf(argv[1], "%lf", &opts.ci);
+			argc -= 2;
+			argv += 2;
+		} else if (strcmp("-max-iters", argv[0]) == 0) {
+			// Take "-max-iters" and "<runs>" from argv, parse int
+			sscanf(argv[1], "%d", &opts.max_iters);
+			argc -= 2;
+			argv += 2;
+		} else if (strcmp("-max-time", argv[0]) == 0) {
+			// Take "-max-time" and "<secs>" from argv, parse double
+			sscanf(argv[1], "%lf", &opts.max_time);
+			argc -= 2;
+			argv += 2;
+		} else {
+			return usage_error();
+		}
+	}
+
+	// Need at least two args for "<output-file>" and "<binary>", one mode at
+	// most and the allocation counting shim forwards to glibc only
+	int thp_modes = opts.thp && strchr(opts.thp, ',');
+	if (argc < 2 || (!!opts.scale + !!opts.sizes + !!opts.allocators + thp_modes) > 1 || (opts.allocstat && opts.allocators))
+		return usage_error();
+
+	if (placement) {
+		CPU_ZERO(&opts.cpus);
+		CPU_SET(placement->cpu, &opts.cpus);
+		opts.buffer = placement->buffer;
+		if (placement->check)
+			argv[0] = "/dev/null";
+		if (strcmp(argv[0], "-") != 0)
+			freopen("/dev/null", "w", stdout);
+	}
+
+	if (opts.numa) {
+		numa_init(&numa, numa_policy_id, &opts.cpus);
+		if (numa.mode < 0)
+			fprintf(stderr, "Warning: \"-numa %s\" has no effect, applied policy is %s.\n", numa_names[numa_policy_id], numa.applied);
+	}
+
+	// Take "<output-file>" from argv, redirect to stdout or open as append
+	FILE* outfile;
+	if (strncmp(argv[0], "-", 1) == 0) {
+		outfile = stdout;
+	} else {
+		outfile = fopen(argv[0], "a");
+		if (!outfile) {
+			perror(argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+	++argv;
+
+	if (opts.cgroup)
+		cgroup_init(opts.cgroup);
+
+	// Check governors, describe machine for run headers
+	struct cpuinfo info;
+	get_cpuinfo(&info);
+	opts.target_freq = info.overall_freq;
+	char machine[64];
+	describe_machine(info, machine, sizeof machine);
+	json.machine = machine;
+
+	// Fixed number of iterations unless stopping on a confidence interval
+	#define NUM_ITERS 5
+	#define MAX_ITERS 50
+	if (opts.max_iters <= 0)
+		opts.max_iters = opts.ci > 0 ? MAX_ITERS : NUM_ITERS;
+
+	if (opts.sizes) {
+		size_bench(&opts, outfile, argv, machine);
+	} else if (load_files(&opts, "")) {
+		if (opts.scale) {
+			scale_bench(&opts, outfile, argv, machine);
+		} else if (opts.allocators) {
+			alloc_bench(&opts, outfile, argv, machine);
+		} else if (thp_modes) {
+			thp_bench(&opts, outfile, argv, machine);
+		} else {
+			struct Summary summary;
+			write_title(outfile, &opts, argv[0], machine);
+			bench(&opts, outfile, argv, &summary);
+			if (median)
+				*median = summary.total;
+		}
+	}
+
+	free_files(&opts);
+	if (opts.samples)
+		fclose(opts.samples->file);
+	if (opts.json)
+		fclose(opts.json->file);
+	if (opts.profile) {
+		profile_write(opts.profile);
+		fclose(opts.profile->file);
+	}
+
+	return EXIT_SUCCESS;
+}
+
+// Start a job in a new process, which stores its median total in result
+pid_t spawn_job(const struct Job *job, const struct Placement *placement, double *result) {
+	fflush(NULL);
+	pid_t pid = fork();
+	if (pid < 0) {
+		perror("fork");
+		exit(EXIT_FAILURE);
+	} else if (pid == 0) {
+		exit(bench_args(job->argc, job->argv, placement, result));
+	}
+	return pid;
+}
+
+// Run a campaign. Jobs which only need one cpu run concurrently, one per cpu
+// of the set, each with its own output buffer. Jobs with their own cpu set run
+// alone afterwards. Finally, check_jobs of the concurrent jobs are repeated
+// serially to check for interference through shared caches and memory.
+int run_jobs(const struct Job *jobs, size_t count, const char *cpu_list, int check_jobs) {
+	cpu_set_t set;
+	if (!parse_cpus(cpu_list, &set))
+		return usage_error();
+
+	int slots = CPU_COUNT(&set);
+	int *cpus = (int *) malloc(sizeof(int) * slots);
+	pid_t *pids = (pid_t *) calloc(slots, sizeof(pid_t));
+	char (*buffers)[64] = malloc(sizeof *buffers * slots);
+	for (int cpu = 0, slot = 0; slot < slots; ++cpu) {
+		if (!CPU_ISSET(cpu, &set))
+			continue;
+		cpus[slot] = cpu;
+		snprintf(buffers[slot++], sizeof *buffers, "%s.%d", BUFFER, cpu);
+	}
+
+	// Medians are written by the job processes
+	double *concurrent = (double *) mmap(NULL, sizeof(double) * (count + 1), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	double *serial = concurrent + count;
+	int *job_cpus = (int *) malloc(sizeof(int) * count);
+	if (concurrent == MAP_FAILED) {
+		perror("mmap results");
+		return EXIT_FAILURE;
+	}
+	for (size_t i = 0; i < count; ++i)
+		concurrent[i] = NAN;
+
+	// Fill free slots, wait for any job when all are busy. Helper threads of
+	// the jobs (verifier, sampler, ...) keep off the campaign cpus.
+	campaign_cpus = set;
+	size_t shared = 0;
+	for (size_t i = 0; i < count; ++i) {
+		if (jobs[i].exclusive)
+			continue;
+
+		int slot = 0;
+		while (slot < slots && pids[slot])
+			++slot;
+		while (slot == slots) {
+			pid_t done = wait(NULL);
+			if (done < 0 && errno == EINTR)
+				continue;
+			if (done < 0) {
+				// No jobs left to wait for, all slots are free
+				perror("wait");
+				memset(pids, 0, sizeof(pid_t) * slots);
+				slot = 0;
+				break;
+			}
+
+			// Other children don't free a slot
+			for (slot = 0; slot < slots && pids[slot] != done; ++slot);
+		}
+
+		printf("Job %zu/%zu on cpu %d: %s\n", i + 1, count, cpus[slot], jobs[i].line);
+		struct Placement placement = { cpus[slot], buffers[slot], 0 };
+		pids[slot] = spawn_job(&jobs[i], &placement, &concurrent[i]);
+		job_cpus[i] = cpus[slot];
+		++shared;
+	}
+	while (wait(NULL) > 0);
+
+	// Jobs with their own cpu set get the machine to themselves
+	CPU_ZERO(&campaign_cpus);
+	for (size_t i = 0; i < count; ++i) {
+		if (!jobs[i].exclusive)
+			continue;
+
+		printf("Job %zu/%zu alone: %s\n", i + 1, count, jobs[i].line);
+		waitpid(spawn_job(&jobs[i], NULL, &concurrent[i]), NULL, 0);
+	}
+
+	// Repeat evenly spaced concurrent jobs on their cpu, without writing results
+	if (check_jobs > 0 && shared > 0) {
+		printf("Interference check (median total)\n");
+		printf("cpu    " CSV_SEP "shared " CSV_SEP "alone  " CSV_SEP "change " CSV_SEP "job\n");
+
+		// Same helper placement as in the concurrent runs
+		campaign_cpus = set;
+		size_t step = (shared + check_jobs - 1) / check_jobs, index = 0;
+		for (size_t i = 0; i < count; ++i) {
+			if (jobs[i].exclusive || index++ % step || isnan(concurrent[i]))
+				continue;
+
+			struct Placement placement = { job_cpus[i], buffers[0], 1 };
+			*serial = NAN;
+			waitpid(spawn_job(&jobs[i], &placement, serial), NULL, 0);
+
+			printf("%7d" CSV_SEP "%7.3f" CSV_SEP "%7.3f" CSV_SEP "%6.1f%%" CSV_SEP "%s\n", job_cpus[i],
+				concurrent[i], *serial, (concurrent[i] / *serial - 1) * 100, jobs[i].line);
+		}
+	}
+
+	CPU_ZERO(&campaign_cpus);
+	munmap(concurrent, sizeof(double) * (count + 1));
+	free(job_cpus);
+	free(buffers);
+	free(pids);
+	free(cpus);
 	return EXIT_SUCCESS;
 }
+
+// Run the jobs of a job file
+int campaign(const char *job_file, const char *cpu_list, int check_jobs) {
+	size_t count;
+	struct Job *jobs = load_jobs(job_file, &count);
+	if (!jobs)
+		return EXIT_FAILURE;
+
+	int result = run_jobs(jobs, count, cpu_list, check_jobs);
+	free_jobs(jobs, count);
+	return result;
+}
+
+// Run command in the shell with stdin and stdout redirected to in (-1 to keep
+// stdin) and out. Returns 0 on error.
+int run_command(const char *command, int in, int out) {
+	fflush(NULL);
+	pid_t pid = fork();
+	if (pid < 0) {
+		perror("fork");
+		return 0;
+	} else if (pid == 0) {
+		// Own file offset, the input is shared
+		if (in >= 0) {
+			char path[32];
+			snprintf(path, sizeof path, "/proc/self/fd/%d", in);
+			in = open(path, O_RDONLY);
+			if (in < 0) {
+				perror(path);
+				_exit(127);
+			}
+			dup2(in, STDIN_FILENO);
+		}
+		dup2(out, STDOUT_FILENO);
+		execl("/bin/sh", "sh", "-c", command, (char *) NULL);
+		perror("/bin/sh");
+		_exit(127);
+	}
+
+	int status;
+	return waitpid(pid, &status, 0) == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+// Create a missing reference with command, input is a resident memfd or -1.
+// Returns 0 on error.
+int create_reference(const char *reference, const char *command, int input) {
+	printf("Creating %s: %s\n", reference, command);
+
+	// Only complete references get their name
+	char *partial = (char *) malloc(strlen(reference) + 6);
+	sprintf(partial, "%s.part", reference);
+
+	int out = open(partial, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (out < 0)
+		perror(partial);
+	int ok = out >= 0 && run_command(command, input, out);
+	if (out >= 0)
+		close(out);
+
+	ok = ok && rename(partial, reference) == 0;
+	if (!ok) {
+		fprintf(stderr, "Error: Could not create %s.\n", reference);
+		unlink(partial);
+	}
+	free(partial);
+	return ok;
+}
+
+// Write a resident memfd to the (missing) file of its name, returns 0 on error
+int save_resident(const char *filename) {
+	size_t length = 0;
+	const char *text = resident_text(filename, &length);
+	printf("Writing %s from memory\n", filename);
+
+	// Only complete files get their name
+	char *partial = (char *) malloc(strlen(filename) + 6);
+	sprintf(partial, "%s.part", filename);
+
+	int out = open(partial, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (out < 0)
+		perror(partial);
+	size_t written = 0;
+	ssize_t result = 1;
+	while (out >= 0 && written < length && (result = write(out, text + written, length - written)) > 0)
+		written += result;
+	int ok = out >= 0 && written == length;
+	if (out >= 0 && close(out))
+		ok = 0;
+
+	ok = ok && rename(partial, filename) == 0;
+	if (!ok) {
+		fprintf(stderr, "Error: Could not write %s.\n", filename);
+		unlink(partial);
+	}
+	free(partial);
+	return ok;
+}
+
+// Generate the reference of type at size into a sealed memfd, once per
+// campaign. It stays resident under the name of the reference file, which
+// is not read. Caller has to free the name, NULL on error.
+char *prepare_input(const struct BenchType *type, const char *size) {
+	char *name = substitute(type->reference, size);
+	if (resident_find(name))
+		return name;
+
+	char *command = substitute(type->command, size);
+	printf("Generating %s in memory: %s\n", name, command);
+
+	int fd = memfd_create(name, MFD_CLOEXEC | MFD_ALLOW_SEALING);
+	if (fd < 0)
+		perror("memfd_create");
+	int ok = fd >= 0 && run_command(command, -1, fd)
+		&& fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL) == 0
+		&& keep_memfd(name, fd);
+	free(command);
+
+	if (!ok) {
+		fprintf(stderr, "Error: Could not generate %s.\n", name);
+		if (fd >= 0)
+			close(fd);
+		free(name);
+		return NULL;
+	}
+	return name;
+}
+
+// Reference of type at size, created if it is missing. Caller has to free the
+// result, NULL on error.
+char *prepare_reference(const struct Manifest *manifest, const struct BenchType *type, const char *size) {
+	char *reference = substitute(type->reference, size);
+	if (access(reference, F_OK) == 0)
+		return reference;
+
+	// Generated inputs are not generated again
+	if (resident_find(reference)) {
+		if (save_resident(reference))
+			return reference;
+		free(reference);
+		return NULL;
+	}
+
+	char *input = type->input ? prepare_input(manifest_type(manifest, type->input), size) : NULL;
+	char *command = substitute(type->command, size);
+	if ((type->input && !input) || !create_reference(reference, command, input ? resident_find(input)->fd : -1)) {
+		free(reference);
+		reference = NULL;
+	}
+	free(command);
+	free(input);
+	return reference;
+}
+
+// Digest next to reference, created if it is missing or outdated. Caller has
+// to free the result, NULL on error.
+char *prepare_digest(const char *reference) {
+	char *digest = (char *) malloc(strlen(reference) + 8);
+	sprintf(digest, "%s.digest", reference);
+
+	struct stat reference_info, digest_info;
+	if (stat(reference, &reference_info) == 0 && stat(digest, &digest_info) == 0 && digest_info.st_mtime >= reference_info.st_mtime)
+		return digest;
+
+	// Generated inputs are hashed from memory
+	int fd = resident_fd(reference);
+	FILE *in = fd >= 0 ? fdopen(fd, "r") : NULL;
+	int ok = in ? digest_write(reference, in, digest) : digest_create(reference, digest);
+	if (in)
+		fclose(in);
+	else if (fd >= 0)
+		close(fd);
+
+	if (!ok) {
+		free(digest);
+		return NULL;
+	}
+	return digest;
+}
+
+// Add a job for every built variant of every program of type
+void add_type_jobs(const struct Manifest *manifest, const struct BenchType *type, const char *options, const char *input, const char *check, struct Job **jobs, size_t *count, size_t *capacity) {
+	size_t source_count;
+	char **sources = type_sources(type, &source_count);
+	if (!sources)
+		return;
+
+	char *diff = substitute(type->diff ? type->diff : "", type->size);
+	char *args = substitute(type->args ? type->args : "", type->size);
+	for (size_t i = 0; i < source_count; ++i) {
+		char first[512] = "";
+		for (int variant = 0; variant < manifest->variant_count; ++variant) {
+			char binary[512];
+			snprintf(binary, sizeof binary, "%s%s", sources[i], manifest->variants[variant]);
+			// Further variants are optional
+			if (access(binary, X_OK) != 0) {
+				if (variant == 0)
+					fprintf(stderr, "Warning: Skipping %s, it is not built.\n", binary);
+				continue;
+			}
+
+			// Variants identical to the first one are not benchmarked again
+			if (variant == 0)
+				strcpy(first, binary);
+			else if (*first && same_contents(first, binary))
+				continue;
+
+			// Results go next to the binary, ".run" is replaced by ".bm"
+			char result[512];
+			size_t length = strlen(binary);
+			if (length > 4 && strcmp(binary + length - 4, ".run") == 0)
+				length -= 4;
+			snprintf(result, sizeof result, "%.*s.bm", (int) length, binary);
+
+			const char *variant_options = manifest->variant_options[variant];
+			char *line = (char *) malloc(strlen(options) + strlen(variant_options) + (input ? strlen(input) : 0) + strlen(check) + strlen(diff) + strlen(result) + strlen(binary) + strlen(args) + 32);
+			char *out = stpcpy(line, options);
+			if (*variant_options)
+				out += sprintf(out, "%s ", variant_options);
+			if (input)
+				out += sprintf(out, "-i %s ", input);
+			out += sprintf(out, "%s %s ", type->digest ? "-digest" : "-diff", check);
+			if (*diff)
+				out += sprintf(out, "%s ", diff);
+			sprintf(out, "%s %s %s", result, binary, args);
+
+			if (*count == *capacity) {
+				*capacity *= 2;
+				*jobs = (struct Job *) realloc(*jobs, sizeof(struct Job) * *capacity);
+			}
+			struct Job *job = &(*jobs)[(*count)++];
+			memset(job, 0, sizeof *job);
+			parse_job(job, line);
+		}
+	}
+
+	free(diff);
+	free(args);
+	for (size_t i = 0; i < source_count; ++i)
+		free(sources[i]);
+	free(sources);
+}
+
+// Run every program of a manifest as a campaign. Arguments "<type>=<size>"
+// override sizes, further arguments are bencher options for every job.
+// Inputs are generated into memory once, missing references and digests are
+// created. References (or their digests) are loaded once and stay resident
+// together with the inputs for all jobs.
+int run_manifest(const char *filename, const char *cpu_list, int check_jobs, int argc, char **argv) {
+	struct Manifest manifest;
+	if (!load_manifest(filename, &manifest))
+		return EXIT_FAILURE;
+
+	// Take "<type>=<size>" from argv
+	for (; argc > 0 && argv[0][0] != '-'; --argc, ++argv) {
+		char *size = strchr(argv[0], '=');
+		struct BenchType *type = NULL;
+		if (size) {
+			*size = 0;
+			type = manifest_type(&manifest, argv[0]);
+			*size = '=';
+		}
+		if (!type) {
+			free_manifest(&manifest);
+			return usage_error();
+		}
+		free(type->size);
+		type->size = strdup(size + 1);
+	}
+
+	// Options for every job, quoted for the job parser if needed
+	size_t length = 1;
+	for (int i = 0; i < argc; ++i)
+		length += strlen(argv[i]) + 3;
+	char *options = (char *) malloc(length), *out = options;
+	*out = 0;
+	for (int i = 0; i < argc; ++i)
+		out += sprintf(out, strpbrk(argv[i], " \t") ? "\"%s\" " : "%s ", argv[i]);
+
+	// Generate inputs first, references of input types at the same size are
+	// then written from memory instead of being generated again
+	int ok = 1;
+	for (size_t i = 0; ok && i < manifest.type_count; ++i) {
+		const struct BenchType *type = &manifest.types[i];
+		if (!type->input)
+			continue;
+		char *input = prepare_input(manifest_type(&manifest, type->input), type->size);
+		ok = input != NULL;
+		free(input);
+	}
+
+	size_t count = 0, capacity = 16;
+	struct Job *jobs = (struct Job *) malloc(sizeof(struct Job) * capacity);
+	for (size_t i = 0; ok && i < manifest.type_count; ++i) {
+		const struct BenchType *type = &manifest.types[i];
+		char *reference = prepare_reference(&manifest, type, type->size);
+		char *input = type->input ? prepare_input(manifest_type(&manifest, type->input), type->size) : NULL;
+		char *check = reference && type->digest ? prepare_digest(reference) : reference;
+
+		ok = check && (!type->input || input);
+		if (ok)
+			ok = keep_file(check, type->digest);
+		if (ok)
+			add_type_jobs(&manifest, type, options, input, check, &jobs, &count, &capacity);
+
+		if (check != reference)
+			free(check);
+		free(reference);
+		free(input);
+	}
+
+	int result = ok ? run_jobs(jobs, count, cpu_list, check_jobs) : EXIT_FAILURE;
+	free_jobs(jobs, count);
+	free(options);
+	free_manifest(&manifest);
+	return result;
+}
+
+int main(int argc, char** argv) {
+	// Strip first argument containing program name
+	--argc;
+	++argv;
+
+	// Create digest of a reference output: "-mkdigest" "<reference-file>" "<digest-file>"
+	if (argc == 3 && strcmp("-mkdigest", argv[0]) == 0)
+		return digest_create(argv[1], argv[2]) ? EXIT_SUCCESS : EXIT_FAILURE;
+
+	// Run jobs concurrently: "-campaign" "<job-file>" ["<cpu-list>" ["<check-jobs>"]]
+	if (argc >= 2 && argc <= 4 && strcmp("-campaign", argv[0]) == 0)
+		return campaign(argv[1], argc > 2 ? argv[2] : "one-per-core", argc > 3 ? atoi(argv[3]) : 0);
+
+	// Run a manifest: "-manifest" "<manifest-file>" "<cpu-list>" "<check-jobs>" ["<type>=<size>"]... [<bencher options>...]
+	if (argc >= 4 && strcmp("-manifest", argv[0]) == 0)
+		return run_manifest(argv[1], argv[2], atoi(argv[3]), argc - 4, argv + 4);
+
+	return bench_args(argc, argv, NULL, NULL);
+}
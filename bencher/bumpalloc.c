@@ -0,0 +1,120 @@
+// Bump allocator which never frees, preloaded by "bencher -allocators" as a
+// lower bound of allocation cost. Every thread bumps through its own chunks,
+// a header in front of each block stores its size for realloc. Memory grows
+// with every allocation, so limit it (-cgroup) for programs with much churn.
+#define _GNU_SOURCE
+
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include <sys/mman.h>
+
+#define CHUNK_SIZE (4 * 1024 * 1024)
+#define HEADER 16 // Keeps blocks 16 byte aligned
+
+// Initial-exec TLS does not allocate
+static __thread char *next __attribute__((tls_model("initial-exec")));
+static __thread char *end __attribute__((tls_model("initial-exec")));
+
+static char *map(size_t length) {
+	char *chunk = (char *) mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	return chunk == MAP_FAILED ? NULL : chunk;
+}
+
+// Blocks are never reused, so they are always zeroed. Alignment is at least
+// the header size.
+static void *bump(size_t size, size_t alignment) {
+	if (size > SIZE_MAX - CHUNK_SIZE - alignment) {
+		errno = ENOMEM;
+		return NULL;
+	}
+	size = (size + HEADER - 1) & ~(size_t) (HEADER - 1);
+
+	// Header and padding fit into alignment bytes in front of the block
+	size_t needed = size + alignment;
+	char *start;
+	if (needed > CHUNK_SIZE / 4) {
+		// Large blocks get their own mapping, keeping the current chunk
+		start = map(needed);
+	} else {
+		if (!next || (size_t) (end - next) < needed) {
+			next = map(CHUNK_SIZE);
+			end = next ? next + CHUNK_SIZE : NULL;
+		}
+		start = next;
+	}
+	if (!start) {
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	char *ptr = (char *) (((uintptr_t) start + HEADER + alignment - 1) & ~(uintptr_t) (alignment - 1));
+	((size_t *) ptr)[-1] = size;
+	if (start == next)
+		next = ptr + size;
+	return ptr;
+}
+
+void *malloc(size_t size) {
+	return bump(size, HEADER);
+}
+
+void free(void *ptr) {
+	(void) ptr;
+}
+
+size_t malloc_usable_size(void *ptr) {
+	return ptr ? ((size_t *) ptr)[-1] : 0;
+}
+
+void *calloc(size_t count, size_t size) {
+	if (size && count > SIZE_MAX / size) {
+		errno = ENOMEM;
+		return NULL;
+	}
+	return bump(count * size, HEADER);
+}
+
+void *realloc(void *ptr, size_t size) {
+	size_t usable = malloc_usable_size(ptr);
+	if (ptr && size <= usable)
+		return ptr;
+
+	void *result = bump(size, HEADER);
+	if (result && ptr)
+		memcpy(result, ptr, usable);
+	return result;
+}
+
+void *memalign(size_t alignment, size_t size) {
+	if (alignment & (alignment - 1)) {
+		errno = EINVAL;
+		return NULL;
+	}
+	return bump(size, alignment > HEADER ? alignment : HEADER);
+}
+
+void *aligned_alloc(size_t alignment, size_t size) {
+	return memalign(alignment, size);
+}
+
+int posix_memalign(void **ptr, size_t alignment, size_t size) {
+	if (alignment % sizeof(void *) || (alignment & (alignment - 1)))
+		return EINVAL;
+	void *result = memalign(alignment, size);
+	if (!result)
+		return errno;
+	*ptr = result;
+	return 0;
+}
+
+void *valloc(size_t size) {
+	return memalign(sysconf(_SC_PAGESIZE), size);
+}
+
+void *pvalloc(size_t size) {
+	size_t page = sysconf(_SC_PAGESIZE);
+	return memalign(page, (size + page - 1) & ~(page - 1));
+}
@@ -0,0 +1,98 @@
+#ifndef _CAMPAIGN_H
+#define _CAMPAIGN_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// A campaign is a file with one list of bencher arguments per line (without
+// the bencher binary), split at unquoted whitespace. Empty lines and lines starting
+// with '#' are skipped.
+
+struct Job {
+    char *line;
+    char *args; // argv points into this copy of line
+    int argc;
+    char **argv;
+
+    // Needs more than one cpu (or a specific one), can't share the machine
+    int exclusive;
+};
+
+// Split line into job arguments, takes ownership of line. Double quotes
+// group arguments containing whitespace, like in the shell.
+void parse_job(struct Job *job, char *line) {
+    job->line = strdup(line);
+    job->args = line;
+    job->argc = 0;
+    job->argv = (char **) malloc(sizeof(char *) * (strlen(line) / 2 + 2));
+
+    // Unquoted arguments are written back into line
+    char *pos = line, *out = line;
+    while (*(pos += strspn(pos, " \t\n"))) {
+        job->argv[job->argc++] = out;
+
+        int quoted = 0;
+        for (; *pos && (quoted || !strchr(" \t\n", *pos)); ++pos) {
+            if (*pos == '"')
+                quoted = !quoted;
+            else
+                *out++ = *pos;
+        }
+        if (*pos)
+            ++pos;
+        *out++ = 0;
+    }
+    job->argv[job->argc] = NULL;
+
+    for (int i = 0; i < job->argc; ++i)
+        if (strcmp(job->argv[i], "-cpus") == 0 || strcmp(job->argv[i], "-scale") == 0)
+            job->exclusive = 1;
+}
+
+// Load jobs from file, returns NULL on error
+struct Job *load_jobs(const char *filename, size_t *count) {
+    FILE *in = fopen(filename, "r");
+    if (!in) {
+        perror(filename);
+        return NULL;
+    }
+
+    size_t capacity = 16;
+    struct Job *jobs = (struct Job *) malloc(sizeof(struct Job) * capacity);
+    *count = 0;
+
+    char *line = NULL;
+    size_t len = 0;
+    while (getline(&line, &len, in) > 0) {
+        // Strip newline, skip empty lines and comments
+        line[strcspn(line, "\n")] = 0;
+        char *start = line + strspn(line, " \t");
+        if (!*start || *start == '#')
+            continue;
+
+        if (*count == capacity) {
+            capacity *= 2;
+            jobs = (struct Job *) realloc(jobs, sizeof(struct Job) * capacity);
+        }
+
+        struct Job *job = &jobs[(*count)++];
+        memset(job, 0, sizeof *job);
+        parse_job(job, strdup(start));
+    }
+
+    free(line);
+    fclose(in);
+    return jobs;
+}
+
+void free_jobs(struct Job *jobs, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        free(jobs[i].args);
+        free(jobs[i].argv);
+        free(jobs[i].line);
+    }
+    free(jobs);
+}
+
+#endif // _CAMPAIGN_H
@@ -0,0 +1,233 @@
+#ifndef _CGROUP_H
+#define _CGROUP_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+
+#include <sys/stat.h>
+#include <sys/resource.h>
+
+// Every run gets its own cgroup v2 below the cgroup of bencher, which limits
+// memory.max and cpu.max and collects peak memory, throttling and pressure
+// stall times (PSI). Without a writable cgroup v2 hierarchy, the memory limit
+// falls back to RLIMIT_AS.
+
+#define CGROUP_LEAF "bencher"
+#define CGROUP_CONTROLLERS "+memory +cpu"
+#define CGROUP_FILE (PATH_MAX + 32) // Room for directory and file name
+
+struct Cgroup {
+    const char *memory_max; // as written to memory.max, "max" for none
+    char cpu_max[32];       // as written to cpu.max
+    int available;
+    char base[PATH_MAX];
+    int runs;
+};
+
+// Results of a single run, -1 if not available
+struct CgroupStats {
+    long peak;               // KiB
+    long long throttled_us;
+    long long cpu_some_us;
+    long long memory_some_us;
+    long long memory_full_us;
+    long oom_kills;
+    long thp_faults;         // Huge pages allocated on page faults
+};
+
+// Write text to a file in dir, returns 0 on error
+int cgroup_write(const char *dir, const char *name, const char *text) {
+    char filename[CGROUP_FILE];
+    snprintf(filename, sizeof filename, "%s/%s", dir, name);
+
+    FILE *file = fopen(filename, "w");
+    if (!file)
+        return 0;
+    int ok = fputs(text, file) >= 0;
+    return fclose(file) == 0 && ok;
+}
+
+// Read a file in dir, caller has to free the result. NULL on error.
+char *cgroup_read(const char *dir, const char *name) {
+    char filename[CGROUP_FILE];
+    snprintf(filename, sizeof filename, "%s/%s", dir, name);
+
+    FILE *file = fopen(filename, "r");
+    if (!file)
+        return NULL;
+
+    // Size of files in cgroupfs is unknown, read a single page
+    char *text = (char *) calloc(4096, 1);
+    if (text && fread(text, 1, 4095, file) == 0) {
+        free(text);
+        text = NULL;
+    }
+    fclose(file);
+    return text;
+}
+
+// Find the cgroup v2 directory of this process, returns 0 if there is none
+int cgroup_self(char *path, size_t length) {
+    char mount[PATH_MAX] = "", type[32], *line = NULL;
+    size_t len = 0;
+    int found = 0;
+
+    // Mount point of the unified hierarchy
+    FILE *file = fopen("/proc/self/mounts", "r");
+    while (file && !found && getline(&line, &len, file) > 0)
+        found = sscanf(line, "%*s %4095s %31s", mount, type) == 2 && strcmp(type, "cgroup2") == 0;
+    if (file)
+        fclose(file);
+
+    // Path within the unified hierarchy (id 0)
+    int ok = 0;
+    file = found ? fopen("/proc/self/cgroup", "r") : NULL;
+    while (file && !ok && getline(&line, &len, file) > 0) {
+        if (strncmp(line, "0::", 3) == 0) {
+            line[strcspn(line, "\n")] = 0;
+            snprintf(path, length, "%s%s", mount, strcmp(line + 3, "/") ? line + 3 : "");
+            ok = 1;
+        }
+    }
+    if (file)
+        fclose(file);
+
+    free(line);
+    return ok;
+}
+
+// Prepare the parent of the per run cgroups, sets cgroup->available
+void cgroup_init(struct Cgroup *cgroup) {
+    cgroup->available = 0;
+    if (!cgroup_self(cgroup->base, sizeof cgroup->base)) {
+        fprintf(stderr, "Warning: No cgroup v2 hierarchy, limiting memory with setrlimit.\n");
+        return;
+    }
+
+    // Other instances of bencher already moved into the leaf
+    size_t length = strlen(cgroup->base);
+    const char *leaf = "/" CGROUP_LEAF;
+    if (length > strlen(leaf) && strcmp(cgroup->base + length - strlen(leaf), leaf) == 0)
+        cgroup->base[length - strlen(leaf)] = 0;
+
+    // Processes can't be in a cgroup which delegates controllers, so move
+    // bencher into a leaf if needed
+    if (!cgroup_write(cgroup->base, "cgroup.subtree_control", CGROUP_CONTROLLERS) && errno == EBUSY) {
+        char leaf_path[PATH_MAX];
+        snprintf(leaf_path, sizeof leaf_path, "%s%s", cgroup->base, leaf);
+        mkdir(leaf_path, 0755);
+        if (!cgroup_write(leaf_path, "cgroup.procs", "0")
+                || !cgroup_write(cgroup->base, "cgroup.subtree_control", CGROUP_CONTROLLERS))
+            fprintf(stderr, "Warning: Could not enable cgroup controllers in %s.\n", cgroup->base);
+    }
+
+    // Check that child cgroups can be created
+    char test[PATH_MAX];
+    snprintf(test, sizeof test, "%s/bencher-%d-test", cgroup->base, getpid());
+    if (mkdir(test, 0755)) {
+        fprintf(stderr, "Warning: Can't create cgroups in %s, limiting memory with setrlimit.\n", cgroup->base);
+        return;
+    }
+    rmdir(test);
+    cgroup->available = 1;
+}
+
+// Create the cgroup for the next run and apply limits, returns 0 on error
+int cgroup_create(struct Cgroup *cgroup, char *path, size_t length) {
+    snprintf(path, length, "%s/bencher-%d-%d", cgroup->base, getpid(), ++cgroup->runs);
+    if (mkdir(path, 0755)) {
+        perror(path);
+        return 0;
+    }
+
+    // Limits need the controllers, warn only once
+    static int warned;
+    int ok = strcmp(cgroup->memory_max, "max") == 0 || cgroup_write(path, "memory.max", cgroup->memory_max);
+    ok &= strncmp(cgroup->cpu_max, "max", 3) == 0 || cgroup_write(path, "cpu.max", cgroup->cpu_max);
+    if (!ok && !warned) {
+        fprintf(stderr, "Warning: Could not apply cgroup limits in %s.\n", path);
+        warned = 1;
+    }
+    return 1;
+}
+
+// Move the calling process into the cgroup (in the child, before execv)
+int cgroup_enter(const char *path) {
+    return cgroup_write(path, "cgroup.procs", "0");
+}
+
+// Value following key in text, -1 if not present
+long long cgroup_field(const char *text, const char *key) {
+    const char *pos = text ? strstr(text, key) : NULL;
+    return pos ? atoll(pos + strlen(key)) : -1;
+}
+
+// Collect statistics of the (empty) cgroup and remove it
+void cgroup_collect(const char *path, struct CgroupStats *stats) {
+    char *text = cgroup_read(path, "memory.peak");
+    stats->peak = text ? atol(text) / 1024 : -1;
+    free(text);
+
+    text = cgroup_read(path, "cpu.stat");
+    stats->throttled_us = cgroup_field(text, "throttled_usec ");
+    free(text);
+
+    // Total stall times, "full" is on the second line
+    text = cgroup_read(path, "cpu.pressure");
+    stats->cpu_some_us = cgroup_field(text, "total=");
+    free(text);
+
+    text = cgroup_read(path, "memory.pressure");
+    stats->memory_some_us = cgroup_field(text, "total=");
+    stats->memory_full_us = text && strchr(text, '\n') ? cgroup_field(strchr(text, '\n'), "total=") : -1;
+    free(text);
+
+    text = cgroup_read(path, "memory.events");
+    stats->oom_kills = cgroup_field(text, "oom_kill ");
+    free(text);
+
+    text = cgroup_read(path, "memory.stat");
+    stats->thp_faults = cgroup_field(text, "thp_fault_alloc ");
+    free(text);
+
+    if (rmdir(path))
+        perror(path);
+}
+
+// Parse a memory size with optional K, M or G suffix, "max" for none
+rlim_t parse_memory_size(const char *text) {
+    if (strcmp(text, "max") == 0)
+        return RLIM_INFINITY;
+
+    char *end;
+    rlim_t size = strtoull(text, &end, 10);
+    switch (*end) {
+        case 'G': case 'g': size *= 1024; // fall through
+        case 'M': case 'm': size *= 1024; // fall through
+        case 'K': case 'k': size *= 1024;
+    }
+    return size;
+}
+
+// Convert a number of cpus (or "max") to the cpu.max format
+void cgroup_cpu_max(struct Cgroup *cgroup, const char *cpus) {
+    #define CGROUP_PERIOD 100000
+    if (strcmp(cpus, "max") == 0)
+        snprintf(cgroup->cpu_max, sizeof cgroup->cpu_max, "max %d", CGROUP_PERIOD);
+    else
+        snprintf(cgroup->cpu_max, sizeof cgroup->cpu_max, "%.0f %d", atof(cpus) * CGROUP_PERIOD, CGROUP_PERIOD);
+}
+
+// Limit address space instead of memory.max (in the child, before execv)
+void cgroup_fallback(const struct Cgroup *cgroup) {
+    struct rlimit limit;
+    getrlimit(RLIMIT_AS, &limit);
+    limit.rlim_cur = parse_memory_size(cgroup->memory_max);
+    setrlimit(RLIMIT_AS, &limit);
+}
+
+#endif // _CGROUP_H
@@ -7,28 +7,41 @@
 #include <math.h>
 
 #include "fileutils.h"
+#include "digest.h"
 
 struct Diff {
 	size_t length;
 	char *text;
 	long double abserr;
 	char binary;
+	struct Digest *digest;
 };
 
+// Compare in chunks, so output can be streamed from a pipe with bounded memory
+#define BINARY_CHUNK (64 * 1024)
 int binary_diff(FILE *file, const struct Diff *diff) {
     int ok = 1;
-    size_t length;
-    char *comp = read_all_ptr(file, &length, 1, "Buffer");
+    size_t length = 0, read;
+    char *chunk = (char *) malloc(BINARY_CHUNK);
+
+    while ((read = fread(chunk, 1, BINARY_CHUNK, file)) > 0) {
+        // Keep reading after a mismatch to find the total length
+        if (ok && length < diff->length) {
+            size_t compare = read < diff->length - length ? read : diff->length - length;
+            if (memcmp(diff->text + length, chunk, compare) != 0) {
+                fprintf(stderr, "Error: Binary data mismatch.\n");
+                ok = 0;
+            }
+        }
+        length += read;
+    }
 
     if (length != diff->length) {
         fprintf(stderr, "Error: Binary data lengths differ. (Expected %ld, got %ld)\n", diff->length, length);
         ok = 0;
-    } else if (memcmp(diff->text, comp, length) != 0) {
-        fprintf(stderr, "Error: Binary data mismatch.\n");
-        ok = 0;
     }
 
-    free(comp);
+    free(chunk);
     return ok;
 }
 
@@ -44,125 +57,269 @@ void more_errors(int count, const char *text) {
     }
 }
 
-void early_end_error(char **line, size_t *len, FILE *file, int *ok) {
-    *ok = 0;
+// Print up to DIFF_COUNT lines of text, returns the number of lines
+int print_lines(const char *text, size_t length) {
+    const char *end = text + length;
+    int linecnt = 0;
 
-    fprintf(stderr, "Error: Expected result ended before end of actual result.\n");
-    fprintf(stderr, "Remaining:\n  %s", *line);
+    while (text < end) {
+        const char *line_end = (const char *) memchr(text, '\n', end - text);
+        if (!line_end)
+            line_end = end;
 
-    int linecnt = 1;
-	ssize_t read;
-    while ((read = getline(line, len, file)) != -1) {
         if (linecnt < DIFF_COUNT)
-            fprintf(stderr, "  %s", *line);
+            fprintf(stderr, "  %.*s\n", (int) (line_end - text), text);
         ++linecnt;
+
+        text = line_end + 1;
     }
 
-    more_errors(linecnt, "line");
+    return linecnt;
+}
+
+// Progress of a textual diff, output can be fed in pieces
+struct DiffState {
+    const struct Diff *diff;
+    size_t position; // in diff text, always at a line start
+    int ok;
+    int error_count;
+    int extra_lines; // output lines after the end of diff text, -1 if none
+};
+
+void diff_init(struct DiffState *state, const struct Diff *diff) {
+    state->diff = diff;
+    state->position = 0;
+    state->ok = 1;
+    state->error_count = 0;
+    state->extra_lines = -1;
 }
 
-void internal_error(size_t diff_line, char *diff_text, char *line, long double err, int *ok, int *error_count) {
-    if (*ok) {
+void internal_error(struct DiffState *state, const char *expected, size_t expected_length, const char *actual, size_t actual_length, long double err) {
+    if (state->ok) {
         fprintf(stderr, "Error: Diff failed.\n");
-        *ok = 0;
+        state->ok = 0;
     }
 
-    if (*error_count < DIFF_COUNT) {
-        fprintf(stderr, "  Baseline: %.*s", (int) diff_line, diff_text);
-        fprintf(stderr, "  Current:  %s", line);
+    if (state->error_count < DIFF_COUNT) {
+        fprintf(stderr, "  Baseline: %.*s\n", (int) expected_length, expected);
+        fprintf(stderr, "  Current:  %.*s\n", (int) actual_length, actual);
         if (err != 0.0)
             fprintf(stderr, "  Error:     %Lg\n", err);
     }
-    ++ *error_count;
+    ++ state->error_count;
 }
 
-void ending_errors(char *diff_text, const struct Diff *diff, int error_count, int *ok) {
-    more_errors(error_count, "error");
+// Parse the leading number of a line, which is not '\0' terminated
+long double parse_number(const char *line, size_t length) {
+    char buffer[128];
+    if (length >= sizeof buffer)
+        length = sizeof buffer - 1;
+    memcpy(buffer, line, length);
+    buffer[length] = 0;
+
+    long double value;
+    if (sscanf(buffer, "%Lf", &value) != 1)
+        return NAN;
+    return value;
+}
 
-	// Print error, when output ended before diff
-	if (diff_text != diff->text + diff->length) {
-        *ok = 0;
+long double numdiff(const char *expected, size_t expected_length, const char *actual, size_t actual_length) {
+    return fabsl(parse_number(actual, actual_length) - parse_number(expected, expected_length));
+}
 
-        fprintf(stderr, "Error: Actual result ended before end of expected result.\n");
+// Length of the common prefix. Whole blocks are compared with memcmp, which
+// libc implements with vector instructions, bytes are only looked at in the
+// first block that differs.
+#define DIFF_BLOCK 4096
+size_t common_prefix(const char *a, const char *b, size_t length) {
+    size_t pos = 0;
+    while (length - pos >= DIFF_BLOCK && memcmp(a + pos, b + pos, DIFF_BLOCK) == 0)
+        pos += DIFF_BLOCK;
+    while (pos < length && a[pos] == b[pos])
+        ++pos;
+    return pos;
+}
+
+// Count (and print the first) output lines after the end of the diff text
+size_t extra_output(struct DiffState *state, const char *actual, size_t length, int final) {
+    if (state->extra_lines < 0) {
+        state->ok = 0;
+        state->extra_lines = 0;
+        fprintf(stderr, "Error: Expected result ended before end of actual result.\n");
         fprintf(stderr, "Remaining:\n");
+    }
 
-        int linecnt = 0;
-        char *line_end;
-        while ((line_end = strchr(diff_text, '\n'))) {
-            if (linecnt < DIFF_COUNT)
-                fprintf(stderr, "  %.*s\n", (int) (line_end - diff_text), diff_text);
-            ++linecnt;
+    // Only complete lines, unless this is the end of output
+    size_t consumed = length;
+    if (!final) {
+        while (consumed > 0 && actual[consumed - 1] != '\n')
+            --consumed;
+    }
 
-            diff_text = line_end + 1;
-        }
+    const char *end = actual + consumed;
+    for (const char *line = actual; line < end;) {
+        const char *line_end = (const char *) memchr(line, '\n', end - line);
+        if (!line_end)
+            line_end = end;
 
-        more_errors(linecnt, "line");
+        if (state->extra_lines < DIFF_COUNT)
+            fprintf(stderr, "  %.*s\n", (int) (line_end - line), line);
+        ++ state->extra_lines;
+
+        line = line_end + 1;
     }
+
+    return consumed;
 }
 
-long double numdiff(char *diff_text, char *line) {
-    long double expected, actual;
+// Compare output against the diff text at the current position. Output may
+// end in an incomplete line unless final, which is then left unconsumed.
+// Lines are only split and parsed around differing bytes.
+// Returns the number of bytes consumed.
+size_t diff_feed(struct DiffState *state, const char *actual, size_t length, int final) {
+    const char *expected = state->diff->text;
+    size_t expected_length = state->diff->length;
+    size_t pos = 0; // in output, always at a line start
+
+    if (state->extra_lines >= 0)
+        return extra_output(state, actual, length, final);
+
+    while (pos < length) {
+        size_t expected_pos = state->position;
+        size_t overlap = length - pos < expected_length - expected_pos ? length - pos : expected_length - expected_pos;
+        size_t common = common_prefix(actual + pos, expected + expected_pos, overlap);
+        size_t diff_pos = pos + common;
+
+        // Start of the line containing the first difference
+        size_t line_start = diff_pos;
+        while (line_start > pos && actual[line_start - 1] != '\n')
+            --line_start;
+
+        if (common == overlap && diff_pos == length) {
+            // Output ends without difference, keep incomplete line for later
+            if (final)
+                line_start = length;
+            state->position = expected_pos + (line_start - pos);
+            return line_start;
+        }
+
+        if (common == overlap && line_start == diff_pos) {
+            // Diff text ended at a line end before the output did
+            state->position = expected_length;
+            return diff_pos + extra_output(state, actual + diff_pos, length - diff_pos, final);
+        }
+
+        // Complete line of the output containing the difference
+        const char *actual_end = (const char *) memchr(actual + diff_pos, '\n', length - diff_pos);
+        if (!actual_end && !final) {
+            state->position = expected_pos + (line_start - pos);
+            return line_start;
+        }
+        size_t actual_line_end = actual_end ? (size_t) (actual_end - actual) : length;
+
+        // Corresponding line of the diff text
+        size_t expected_line_start = expected_pos + (line_start - pos);
+        size_t expected_diff_pos = expected_pos + common;
+        const char *expected_end = (const char *) memchr(expected + expected_diff_pos, '\n', expected_length - expected_diff_pos);
+        size_t expected_line_end = expected_end ? (size_t) (expected_end - expected) : expected_length;
+
+        // Numerical diff as fallback
+        long double err = 0.0;
+        int result = 0;
+        if (state->diff->abserr != 0) {
+            err = numdiff(expected + expected_line_start, expected_line_end - expected_line_start,
+                actual + line_start, actual_line_end - line_start);
+            result = err <= state->diff->abserr;
+        }
 
-    int pos;
-    sscanf(diff_text, "%Lf%n", &expected, &pos);
-    sscanf(line, "%Lf", &actual);
+        // Print failure
+        if (!result)
+            internal_error(state, expected + expected_line_start, expected_line_end - expected_line_start,
+                actual + line_start, actual_line_end - line_start, err);
 
-    return fabsl(actual - expected);
+        // Continue after the line on both sides
+        pos = actual_line_end < length ? actual_line_end + 1 : length;
+        state->position = expected_line_end < expected_length ? expected_line_end + 1 : expected_length;
+    }
+
+    return pos;
 }
 
-int textual_diff(FILE *file, const struct Diff *diff) {
-	// Variables for getline
-	char *line = NULL;
-	size_t len = 0;
-	ssize_t read;
-
-	// Current position
-	char *diff_text = diff->text;
-
-	// Current Status
-	int ok = 1;
-	int error_count = 0;
-	while ((read = getline(&line, &len, file)) != -1) {
-		// Find diff line-end
-		char *diff_next = strchr(diff_text, '\n');
-
-		// Print error when diff ended before output
-		if (!diff_next) {
-            early_end_error(&line, &len, file, &ok);
-			break;
-		}
-		++diff_next; // include newline
+// Report errors after all output has been fed, returns result of diff
+int diff_finish(struct DiffState *state) {
+    more_errors(state->error_count, "error");
+    if (state->extra_lines >= 0)
+        more_errors(state->extra_lines, "line");
 
-		// Calculate length of diff line
-		size_t diff_line = diff_next - diff_text;
+    // Print error, when output ended before diff
+    if (state->position < state->diff->length) {
+        state->ok = 0;
 
-		// Textual diff first
-		// Unsing min is fine here because both strings include a terminating '\n'
-		#define MIN(a, b) (b) ^ (((a) ^ (b)) & -((a) < (b)))
-		int result = strncmp(line, diff_text, MIN(read, diff_line));
+        fprintf(stderr, "Error: Actual result ended before end of expected result.\n");
+        fprintf(stderr, "Remaining:\n");
 
+        int linecnt = print_lines(state->diff->text + state->position, state->diff->length - state->position);
+        more_errors(linecnt, "line");
+    }
 
-		// Numerical diff as fallback
-		long double err = 0.0;
-		if (result != 0 && diff->abserr != 0) {
-            err = numdiff(diff_text, line);
-		}
+    return state->ok;
+}
 
-		// Print failure
-		if (result != 0 || err > diff->abserr)
-            internal_error(diff_line, diff_text, line, err, &ok, &error_count);
+// Textual diff of a stream, memory is bounded by the longest line
+#define TEXT_CHUNK (64 * 1024)
+int textual_diff(FILE *file, const struct Diff *diff) {
+    struct DiffState state;
+    diff_init(&state, diff);
+
+    size_t capacity = TEXT_CHUNK, filled = 0;
+    char *buffer = (char *) malloc(capacity);
+
+    int end = 0;
+    while (!end) {
+        // Grow for lines longer than the buffer
+        if (filled == capacity) {
+            capacity *= 2;
+            buffer = (char *) realloc(buffer, capacity);
+        }
 
-		// Advance position of diff
-		diff_text = diff_next;
-	}
+        // fread only returns less than requested at the end of output
+        size_t read = fread(buffer + filled, 1, capacity - filled, file);
+        end = read < capacity - filled;
+        filled += read;
+
+        size_t consumed = diff_feed(&state, buffer, filled, end);
+        memmove(buffer, buffer + consumed, filled - consumed);
+        filled -= consumed;
+    }
+
+    free(buffer);
+    return diff_finish(&state);
+}
 
-    ending_errors(diff_text, diff, error_count, &ok);
+// Diff of output which is completely in memory
+int mapped_diff(const char *output, size_t length, const struct Diff *diff) {
+    if (diff->binary) {
+        if (length != diff->length) {
+            fprintf(stderr, "Error: Binary data lengths differ. (Expected %ld, got %ld)\n", diff->length, length);
+            return 0;
+        } else if (memcmp(diff->text, output, length) != 0) {
+            fprintf(stderr, "Error: Binary data mismatch.\n");
+            return 0;
+        }
+        return 1;
+    }
 
-	free(line);
-	return ok;
+    struct DiffState state;
+    diff_init(&state, diff);
+    diff_feed(&state, output, length, 1);
+    return diff_finish(&state);
 }
 
 int check_output(FILE *file, const struct Diff *diff) {
+	// Compare against hashes of the baseline
+	if (diff->digest)
+		return digest_diff(file, diff->digest, diff->binary);
+
 	// Don't do anything when no diff is provided
 	if (!diff->text)
 		return 1;
@@ -175,4 +332,33 @@ int check_output(FILE *file, const struct Diff *diff) {
     return textual_diff(file, diff);
 }
 
+// Check output file by mapping it to memory
+int check_output_file(const char *filename, const struct Diff *diff) {
+	// Don't do anything when no diff is provided
+	if (!diff->text && !diff->digest)
+		return 1;
+
+	// Digests are computed block by block from the stream
+	if (diff->digest) {
+		FILE *file = fopen(filename, "r");
+		if (!file) {
+			perror(filename);
+			return 0;
+		}
+
+		int result = check_output(file, diff);
+		fclose(file);
+		return result;
+	}
+
+	size_t length;
+	char *output = map_file(filename, &length);
+	if (!output)
+		return 0;
+
+	int result = mapped_diff(output, length, diff);
+	unmap_file(output, length);
+	return result;
+}
+
 #endif // _DIFF_H
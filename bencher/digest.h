@@ -0,0 +1,262 @@
+#ifndef _DIGEST_H
+#define _DIGEST_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+// Reference outputs can be replaced by a digest file, which stores a hash per
+// block and one for the whole file. Output is hashed block by block while it
+// is read, the reference file itself is only opened to print the first
+// mismatching lines.
+//
+// Digest file format (text):
+//   bencher-digest 1
+//   <reference-file>
+//   <length> <block-size> <block-count> <total-hash>
+//   <block-hash>   (one line per block)
+
+#define DIGEST_MAGIC "bencher-digest 1"
+#define DIGEST_BLOCK (1024 * 1024)
+#define DIGEST_LANES 8
+
+struct Digest {
+    char *reference;
+    size_t length;
+    size_t block_size;
+    size_t blocks;
+    uint64_t total;
+    uint64_t *hashes;
+};
+
+uint64_t digest_mix(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ull;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebull;
+    return x ^ (x >> 31);
+}
+
+// Hash a block using independent 32-bit lanes, which compilers vectorize on
+// every target (no 64-bit vector multiply needed). Not cryptographic, but a
+// single changed word always changes the result.
+uint64_t digest_block(const char *data, size_t length) {
+    uint32_t lanes[DIGEST_LANES];
+    for (int i = 0; i < DIGEST_LANES; ++i)
+        lanes[i] = 0x9e3779b9u * (i + 1);
+
+    size_t steps = length / sizeof lanes;
+    for (size_t step = 0; step < steps; ++step) {
+        uint32_t words[DIGEST_LANES];
+        memcpy(words, data + step * sizeof words, sizeof words);
+
+        for (int i = 0; i < DIGEST_LANES; ++i) {
+            uint32_t x = (lanes[i] ^ words[i]) * 0x85ebca6bu;
+            lanes[i] = x ^ (x >> 15);
+        }
+    }
+
+    uint64_t hash = digest_mix(length);
+    for (int i = 0; i < DIGEST_LANES; ++i)
+        hash = digest_mix(hash ^ lanes[i]);
+    for (size_t i = steps * sizeof lanes; i < length; ++i)
+        hash = digest_mix(hash ^ (unsigned char) data[i]);
+
+    return hash;
+}
+
+// Whole-file hash, combined from block hashes and total length
+uint64_t digest_combine(uint64_t total, uint64_t block_hash) {
+    return digest_mix(total ^ block_hash);
+}
+
+// Create digest file from the contents of reference, read from in. Returns 0
+// on error.
+int digest_write(const char *reference, FILE *in, const char *filename) {
+    size_t capacity = 16, blocks = 0, length = 0, read;
+    uint64_t *hashes = (uint64_t *) malloc(sizeof(uint64_t) * capacity);
+    uint64_t total = 0;
+    char *block = (char *) malloc(DIGEST_BLOCK);
+
+    while ((read = fread(block, 1, DIGEST_BLOCK, in)) > 0) {
+        if (blocks == capacity) {
+            capacity *= 2;
+            hashes = (uint64_t *) realloc(hashes, sizeof(uint64_t) * capacity);
+        }
+
+        hashes[blocks] = digest_block(block, read);
+        total = digest_combine(total, hashes[blocks++]);
+        length += read;
+    }
+    total = digest_combine(total, length);
+
+    free(block);
+
+    FILE *out = fopen(filename, "w");
+    if (!out) {
+        perror(filename);
+        free(hashes);
+        return 0;
+    }
+
+    fprintf(out, DIGEST_MAGIC "\n%s\n%zu %d %zu %016llx\n", reference, length, DIGEST_BLOCK, blocks, (unsigned long long) total);
+    for (size_t i = 0; i < blocks; ++i)
+        fprintf(out, "%016llx\n", (unsigned long long) hashes[i]);
+
+    free(hashes);
+    if (fclose(out)) {
+        perror(filename);
+        return 0;
+    }
+    return 1;
+}
+
+// Create digest file for reference, returns 0 on error
+int digest_create(const char *reference, const char *filename) {
+    FILE *in = fopen(reference, "r");
+    if (!in) {
+        perror(reference);
+        return 0;
+    }
+
+    int ok = digest_write(reference, in, filename);
+    fclose(in);
+    return ok;
+}
+
+// Load digest file, returns NULL on error
+struct Digest *digest_load(const char *filename) {
+    FILE *in = fopen(filename, "r");
+    if (!in) {
+        perror(filename);
+        return NULL;
+    }
+
+    struct Digest *digest = (struct Digest *) calloc(1, sizeof(struct Digest));
+    char *line = NULL;
+    size_t len = 0;
+    ssize_t read;
+    unsigned long long value;
+    int ok = 0;
+
+    // Magic, reference filename and sizes
+    if (getline(&line, &len, in) > 0 && strncmp(line, DIGEST_MAGIC, strlen(DIGEST_MAGIC)) == 0
+            && (read = getline(&line, &len, in)) > 1
+            && fscanf(in, "%zu %zu %zu %llx", &digest->length, &digest->block_size, &digest->blocks, &value) == 4) {
+        line[read - 1] = 0;
+        digest->reference = strdup(line);
+        digest->total = value;
+        digest->hashes = (uint64_t *) malloc(sizeof(uint64_t) * (digest->blocks + 1));
+
+        ok = 1;
+        for (size_t i = 0; ok && i < digest->blocks; ++i) {
+            ok = fscanf(in, "%llx", &value) == 1;
+            digest->hashes[i] = value;
+        }
+    }
+
+    free(line);
+    fclose(in);
+
+    if (!ok) {
+        fprintf(stderr, "Error: Invalid digest file %s.\n", filename);
+        free(digest->reference);
+        free(digest->hashes);
+        free(digest);
+        return NULL;
+    }
+
+    return digest;
+}
+
+void digest_free(struct Digest *digest) {
+    if (!digest)
+        return;
+
+    free(digest->reference);
+    free(digest->hashes);
+    free(digest);
+}
+
+// Print the line (within its block) around offset
+void digest_print_line(const char *label, const char *block, size_t length, size_t offset) {
+    size_t start = offset, end = offset;
+    while (start > 0 && block[start - 1] != '\n')
+        --start;
+    while (end < length && block[end] != '\n')
+        ++end;
+
+    fprintf(stderr, "  %s%.*s\n", label, (int) (end - start), block + start);
+}
+
+// Report a mismatching block, fetching the reference only for this block
+void digest_mismatch(const struct Digest *digest, size_t index, const char *block, size_t length, char binary) {
+    size_t offset = index * digest->block_size;
+    fprintf(stderr, "Error: Diff failed in block %zu (offset %zu).\n", index, offset);
+
+    FILE *in = fopen(digest->reference, "r");
+    if (!in || fseek(in, offset, SEEK_SET)) {
+        perror(digest->reference);
+        if (in)
+            fclose(in);
+        return;
+    }
+
+    char *expected = (char *) malloc(digest->block_size);
+    size_t expected_length = fread(expected, 1, digest->block_size, in);
+    fclose(in);
+
+    // First differing byte within the block
+    size_t first = 0;
+    while (first < length && first < expected_length && block[first] == expected[first])
+        ++first;
+
+    if (binary) {
+        fprintf(stderr, "  First difference at offset %zu.\n", offset + first);
+    } else {
+        if (first < expected_length)
+            digest_print_line("Baseline: ", expected, expected_length, first);
+        if (first < length)
+            digest_print_line("Current:  ", block, length, first);
+    }
+
+    free(expected);
+}
+
+// Hash output block by block and compare against digest
+int digest_diff(FILE *file, const struct Digest *digest, char binary) {
+    int ok = 1;
+    size_t index = 0, length = 0, read;
+    uint64_t total = 0;
+    char *block = (char *) malloc(digest->block_size);
+
+    // fread only returns short blocks at the end of the output
+    while ((read = fread(block, 1, digest->block_size, file)) > 0) {
+        uint64_t hash = digest_block(block, read);
+        total = digest_combine(total, hash);
+
+        // Only report the first mismatch
+        if (ok && (index >= digest->blocks || hash != digest->hashes[index])) {
+            digest_mismatch(digest, index, block, read, binary);
+            ok = 0;
+        }
+
+        length += read;
+        ++index;
+    }
+    total = digest_combine(total, length);
+
+    if (length != digest->length) {
+        fprintf(stderr, "Error: Output lengths differ. (Expected %zu, got %zu)\n", digest->length, length);
+        ok = 0;
+    } else if (ok && total != digest->total) {
+        fprintf(stderr, "Error: Output digest mismatch.\n");
+        ok = 0;
+    }
+
+    free(block);
+    return ok;
+}
+
+#endif // _DIGEST_H
@@ -2,7 +2,14 @@
 #define _FILEUTILS_H
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <malloc.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 char *read_all_ptr(FILE* f, size_t *length_out, int check_length, const char *filename) {
 	// Get total length
@@ -49,4 +56,100 @@ char *read_all(const char* filename, size_t *length_out, int check_length)  {
 	return result;
 }
 
+// Map a file read-only, returns NULL on error. Empty files can't be mapped,
+// those result in an empty string.
+char *map_file(const char *filename, size_t *length_out) {
+	int fd = open(filename, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		perror(filename);
+		return NULL;
+	}
+
+	struct stat info;
+	if (fstat(fd, &info)) {
+		perror(filename);
+		close(fd);
+		return NULL;
+	}
+	*length_out = info.st_size;
+
+	char *map = "";
+	if (info.st_size > 0) {
+		map = (char *) mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (map == MAP_FAILED) {
+			perror(filename);
+			map = NULL;
+		} else {
+			madvise(map, info.st_size, MADV_SEQUENTIAL);
+		}
+	}
+
+	close(fd);
+	return map;
+}
+
+void unmap_file(char *map, size_t length) {
+	if (map && length > 0)
+		munmap(map, length);
+}
+
+// Check if two files have the same contents, 0 on error
+int same_contents(const char *a, const char *b) {
+	size_t length_a, length_b;
+	char *text_a = map_file(a, &length_a);
+	char *text_b = map_file(b, &length_b);
+	int same = text_a && text_b && length_a == length_b && memcmp(text_a, text_b, length_a) == 0;
+	unmap_file(text_a, length_a);
+	unmap_file(text_b, length_b);
+	return same;
+}
+
+// File for the report of one run (allocation counts, harness times, startup
+// stamp), -1 on error
+int report_memfd(const char *name) {
+	int fd = memfd_create(name, MFD_CLOEXEC);
+	if (fd < 0)
+		perror(name);
+	return fd;
+}
+
+// Let the benchmark inherit the report fd, named by the environment variable
+// env (in the child, before execv)
+void report_child(int fd, const char *env) {
+	fcntl(fd, F_SETFD, 0);
+
+	char number[12];
+	snprintf(number, sizeof number, "%d", fd);
+	setenv(env, number, 1);
+}
+
+// Copy text into a memfd which is sealed against any further modification.
+// Returns the file descriptor or -1 on error.
+int sealed_memfd(const char *name, const char *text, size_t length) {
+	int fd = memfd_create(name, MFD_CLOEXEC | MFD_ALLOW_SEALING);
+	if (fd < 0) {
+		perror("memfd_create");
+		return -1;
+	}
+
+	// Write all, handling partial writes
+	for (size_t written = 0; written < length;) {
+		ssize_t result = write(fd, text + written, length - written);
+		if (result < 0) {
+			perror(name);
+			close(fd);
+			return -1;
+		}
+		written += result;
+	}
+
+	if (fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL)) {
+		perror(name);
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
 #endif // _FILEUTILS_H
@@ -0,0 +1,56 @@
+#ifndef _JSON_H
+#define _JSON_H
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include <sys/utsname.h>
+
+// Structured results, one JSON object per line and run. Times are in
+// nanoseconds, memory in KiB. Metadata given with "-meta <key>=<value>" is
+// stored in the "meta" object of every record.
+
+#define JSON_META 32
+
+struct JsonLog {
+    FILE *file;
+    const char *meta[JSON_META];
+    int meta_count;
+    const char *machine;
+    struct utsname uts;
+    int runs;
+};
+
+// Write text as JSON string, length -1 for null terminated text
+void json_string(FILE *file, const char *text, int length) {
+    fputc('"', file);
+    for (int i = 0; length < 0 ? text[i] != 0 : i < length; ++i) {
+        unsigned char c = text[i];
+        if (c == '"' || c == '\\')
+            fprintf(file, "\\%c", c);
+        else if (c < 0x20)
+            fprintf(file, "\\u%04x", c);
+        else
+            fputc(c, file);
+    }
+    fputc('"', file);
+}
+
+// Write ",<key>:" (or without comma for the first member)
+void json_key(FILE *file, const char *key, int first) {
+    if (!first)
+        fputc(',', file);
+    json_string(file, key, -1);
+    fputc(':', file);
+}
+
+long long json_ns(const struct timespec *time) {
+    return time->tv_sec * 1000000000ll + time->tv_nsec;
+}
+
+long long json_timeval_ns(const struct timeval *time) {
+    return time->tv_sec * 1000000000ll + time->tv_usec * 1000ll;
+}
+
+#endif // _JSON_H
@@ -0,0 +1,339 @@
+#ifndef _MANIFEST_H
+#define _MANIFEST_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+
+#include "digest.h"
+#include "fileutils.h"
+
+// A manifest declares a whole campaign, which a single bencher process runs
+// ("-manifest"). One statement per line, empty lines and lines starting with
+// '#' are skipped:
+//   variant <suffix> [<options>]  binary of each program, later variants are
+//                                 skipped if identical to the first one, with
+//                                 further bencher options for its jobs
+//   type <name> <size>            starts a type, its programs are the sources
+//                                 in benchmarks/<name>
+//   input <type>                  stdin is the reference of another type at
+//                                 the same size
+//   reference <file> <command>    reference output, created by the command
+//                                 (with the input on stdin) if it is missing
+//   diff digest|text [<options>]  verify against a digest of the reference or
+//                                 its text, with further bencher options
+//   args <arguments>              program arguments
+// Every "{}" is replaced by the size.
+
+#define MANIFEST_DIR "benchmarks"
+#define MANIFEST_VARIANTS 8
+
+struct BenchType {
+    char *name;
+    char *size;
+    char *input;     // Type whose reference is the input, NULL for none
+    char *reference;
+    char *command;   // Creates the reference
+    int digest;
+    char *diff;      // Further bencher options
+    char *args;
+};
+
+struct Manifest {
+    char *variants[MANIFEST_VARIANTS];
+    char *variant_options[MANIFEST_VARIANTS];
+    int variant_count;
+    struct BenchType *types;
+    size_t type_count;
+};
+
+struct BenchType *manifest_type(const struct Manifest *manifest, const char *name) {
+    for (size_t i = 0; i < manifest->type_count; ++i)
+        if (strcmp(manifest->types[i].name, name) == 0)
+            return &manifest->types[i];
+    return NULL;
+}
+
+void free_manifest(struct Manifest *manifest) {
+    for (int i = 0; i < manifest->variant_count; ++i) {
+        free(manifest->variants[i]);
+        free(manifest->variant_options[i]);
+    }
+    for (size_t i = 0; i < manifest->type_count; ++i) {
+        struct BenchType *type = &manifest->types[i];
+        free(type->name);
+        free(type->size);
+        free(type->input);
+        free(type->reference);
+        free(type->command);
+        free(type->diff);
+        free(type->args);
+    }
+    free(manifest->types);
+}
+
+int compare_names(const void *a, const void *b) {
+    return strcmp(*(char * const *) a, *(char * const *) b);
+}
+
+// Sorted paths of the C, C++ and Rust sources of type, NULL on error
+char **type_sources(const struct BenchType *type, size_t *count) {
+    char path[256];
+    snprintf(path, sizeof path, MANIFEST_DIR "/%s", type->name);
+    DIR *dir = opendir(path);
+    if (!dir) {
+        perror(path);
+        return NULL;
+    }
+
+    size_t capacity = 16;
+    char **sources = (char **) malloc(sizeof(char *) * capacity);
+    *count = 0;
+
+    struct dirent *entry;
+    while ((entry = readdir(dir))) {
+        const char *extension = strrchr(entry->d_name, '.');
+        if (!extension || (strcmp(extension, ".c") != 0 && strcmp(extension, ".cpp") != 0 && strcmp(extension, ".rs") != 0))
+            continue;
+
+        if (*count == capacity) {
+            capacity *= 2;
+            sources = (char **) realloc(sources, sizeof(char *) * capacity);
+        }
+        char *source = (char *) malloc(strlen(path) + strlen(entry->d_name) + 2);
+        sprintf(source, "%s/%s", path, entry->d_name);
+        sources[(*count)++] = source;
+    }
+    closedir(dir);
+
+    qsort(sources, *count, sizeof(char *), compare_names);
+    return sources;
+}
+
+// Split off the first word of text, returns the rest without leading
+// whitespace
+char *split_word(char *text) {
+    char *rest = text + strcspn(text, " \t");
+    if (*rest)
+        *rest++ = 0;
+    return rest + strspn(rest, " \t");
+}
+
+// Parse statement into manifest, returns an error message or NULL
+const char *parse_statement(struct Manifest *manifest, char *line, size_t *capacity) {
+    char *rest = split_word(line);
+    struct BenchType *type = manifest->type_count ? &manifest->types[manifest->type_count - 1] : NULL;
+
+    if (strcmp(line, "variant") == 0) {
+        char *options = split_word(rest);
+        if (!*rest || manifest->variant_count == MANIFEST_VARIANTS)
+            return "invalid variant";
+        manifest->variant_options[manifest->variant_count] = strdup(options);
+        manifest->variants[manifest->variant_count++] = strdup(rest);
+    } else if (strcmp(line, "type") == 0) {
+        char *size = split_word(rest);
+        if (!*rest || !*size || strchr(size, ' ') || manifest_type(manifest, rest))
+            return "type needs a new name and a size";
+
+        if (manifest->type_count == *capacity) {
+            *capacity *= 2;
+            manifest->types = (struct BenchType *) realloc(manifest->types, sizeof(struct BenchType) * *capacity);
+        }
+        type = &manifest->types[manifest->type_count++];
+        memset(type, 0, sizeof *type);
+        type->name = strdup(rest);
+        type->size = strdup(size);
+    } else if (!type) {
+        return "statement before the first type";
+    } else if (strcmp(line, "input") == 0) {
+        free(type->input);
+        type->input = strdup(rest);
+    } else if (strcmp(line, "reference") == 0) {
+        char *command = split_word(rest);
+        if (!*command)
+            return "reference needs a file and a command";
+        free(type->reference);
+        free(type->command);
+        type->reference = strdup(rest);
+        type->command = strdup(command);
+    } else if (strcmp(line, "diff") == 0) {
+        char *options = split_word(rest);
+        if (strcmp(rest, "digest") != 0 && strcmp(rest, "text") != 0)
+            return "diff needs digest or text";
+        type->digest = strcmp(rest, "digest") == 0;
+        free(type->diff);
+        type->diff = strdup(options);
+    } else if (strcmp(line, "args") == 0) {
+        free(type->args);
+        type->args = strdup(rest);
+    } else {
+        return "unknown statement";
+    }
+    return NULL;
+}
+
+// Load manifest from file, returns 0 on error
+int load_manifest(const char *filename, struct Manifest *manifest) {
+    FILE *in = fopen(filename, "r");
+    if (!in) {
+        perror(filename);
+        return 0;
+    }
+
+    size_t capacity = 16;
+    memset(manifest, 0, sizeof *manifest);
+    manifest->types = (struct BenchType *) malloc(sizeof(struct BenchType) * capacity);
+
+    const char *error = NULL;
+    char *line = NULL;
+    size_t len = 0, number = 0;
+    while (!error && getline(&line, &len, in) > 0) {
+        // Strip newline and trailing whitespace, skip empty lines and comments
+        ++number;
+        size_t end = strcspn(line, "\n");
+        while (end > 0 && strchr(" \t\r", line[end - 1]))
+            --end;
+        line[end] = 0;
+        char *start = line + strspn(line, " \t");
+        if (*start && *start != '#' && (error = parse_statement(manifest, start, &capacity)))
+            fprintf(stderr, "Error: %s:%zu: %s.\n", filename, number, error);
+    }
+    free(line);
+    fclose(in);
+
+    // Every type needs a reference, inputs have to be references of types
+    // without input themselves
+    for (size_t i = 0; !error && i < manifest->type_count; ++i) {
+        const struct BenchType *type = &manifest->types[i], *source;
+        if (!type->reference)
+            error = "type without reference";
+        else if (type->input && (!(source = manifest_type(manifest, type->input)) || source->input))
+            error = "input has to be a type without input";
+        if (error)
+            fprintf(stderr, "Error: %s, type %s: %s.\n", filename, type->name, error);
+    }
+    if (!error && !manifest->variant_count) {
+        error = "no variant";
+        fprintf(stderr, "Error: %s: %s.\n", filename, error);
+    }
+
+    if (error) {
+        free_manifest(manifest);
+        return 0;
+    }
+    return 1;
+}
+
+// Inputs and references stay mapped for the whole campaign. Jobs run in
+// processes forked from the one which loaded them, so they share the pages
+// instead of reading the files again. Inputs are generated into sealed memfds,
+// which benchmarks can also get as stdin.
+
+struct Resident {
+    char *filename;
+    char *text;            // NULL for digests
+    size_t length;
+    struct Digest *digest;
+    int fd;                // Memfd of generated inputs, -1 for files
+};
+
+struct Resident *resident_files;
+size_t resident_count;
+
+struct Resident *resident_find(const char *filename) {
+    for (size_t i = 0; i < resident_count; ++i)
+        if (strcmp(resident_files[i].filename, filename) == 0)
+            return &resident_files[i];
+    return NULL;
+}
+
+// Keep text or digest of filename in memory, returns 0 on error
+int keep_file(const char *filename, int digest) {
+    if (resident_find(filename))
+        return 1;
+
+    struct Resident loaded = { NULL, NULL, 0, NULL, -1 };
+    if (digest)
+        loaded.digest = digest_load(filename);
+    else
+        loaded.text = map_file(filename, &loaded.length);
+    if (!loaded.digest && !loaded.text)
+        return 0;
+
+    resident_files = (struct Resident *) realloc(resident_files, sizeof(struct Resident) * (resident_count + 1));
+    loaded.filename = strdup(filename);
+    resident_files[resident_count++] = loaded;
+    return 1;
+}
+
+// Keep the contents of a sealed memfd in memory under filename, takes
+// ownership of fd. Returns 0 on error.
+int keep_memfd(const char *filename, int fd) {
+    struct stat info;
+    if (fstat(fd, &info)) {
+        perror(filename);
+        return 0;
+    }
+
+    struct Resident loaded = { NULL, "", (size_t) info.st_size, NULL, fd };
+    if (info.st_size > 0) {
+        loaded.text = (char *) mmap(NULL, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (loaded.text == MAP_FAILED) {
+            perror(filename);
+            return 0;
+        }
+    }
+
+    resident_files = (struct Resident *) realloc(resident_files, sizeof(struct Resident) * (resident_count + 1));
+    loaded.filename = strdup(filename);
+    resident_files[resident_count++] = loaded;
+    return 1;
+}
+
+// New read-only file of a resident memfd with its own offset, -1 if there is
+// none
+int resident_fd(const char *filename) {
+    struct Resident *file = resident_find(filename);
+    if (!file || file->fd < 0)
+        return -1;
+
+    char path[32];
+    snprintf(path, sizeof path, "/proc/self/fd/%d", file->fd);
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        perror(path);
+    return fd;
+}
+
+// Resident text of filename, NULL if it is not resident
+char *resident_text(const char *filename, size_t *length) {
+    struct Resident *file = resident_find(filename);
+    if (!file || !file->text)
+        return NULL;
+    *length = file->length;
+    return file->text;
+}
+
+// Resident digest of filename, NULL if it is not resident
+struct Digest *resident_digest(const char *filename) {
+    struct Resident *file = resident_find(filename);
+    return file ? file->digest : NULL;
+}
+
+// Unmap or free unless resident
+void release_text(char *text, size_t length) {
+    for (size_t i = 0; i < resident_count; ++i)
+        if (resident_files[i].text == text)
+            return;
+    unmap_file(text, length);
+}
+
+void release_digest(struct Digest *digest) {
+    for (size_t i = 0; i < resident_count; ++i)
+        if (resident_files[i].digest == digest)
+            return;
+    digest_free(digest);
+}
+
+#endif // _MANIFEST_H
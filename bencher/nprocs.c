@@ -0,0 +1,34 @@
+// Cpu count shim, preloaded by "bencher -cpus" (see nprocs.h). Reports the
+// cpus of the affinity mask as the online (and configured) cpus, which sizes
+// thread pools taken from std::thread::hardware_concurrency() (get_nprocs in
+// libstdc++) or sysconf(_SC_NPROCESSORS_ONLN) to the pinned set.
+#define _GNU_SOURCE
+
+#include <sched.h>
+#include <unistd.h>
+
+#include <sys/sysinfo.h>
+
+// Entry point of glibc's sysconf, which can be used without dlsym
+extern long __sysconf(int name);
+
+static int pinned_cpus(void) {
+	cpu_set_t set;
+	if (sched_getaffinity(0, sizeof set, &set) || CPU_COUNT(&set) == 0)
+		return 1;
+	return CPU_COUNT(&set);
+}
+
+int get_nprocs(void) {
+	return pinned_cpus();
+}
+
+int get_nprocs_conf(void) {
+	return pinned_cpus();
+}
+
+long sysconf(int name) {
+	if (name == _SC_NPROCESSORS_ONLN || name == _SC_NPROCESSORS_CONF)
+		return pinned_cpus();
+	return __sysconf(name);
+}
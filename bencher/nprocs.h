@@ -0,0 +1,42 @@
+#ifndef _NPROCS_H
+#define _NPROCS_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sched.h>
+#include <unistd.h>
+
+#include "allocstat.h"
+
+// Thread count hints for a benchmark pinned with "-cpus": OMP_NUM_THREADS
+// for OpenMP programs, and output/nprocs.so (built from nprocs.c) for
+// programs sizing their thread pools from hardware_concurrency() or
+// _SC_NPROCESSORS_ONLN, which otherwise count all online cpus. A value of
+// OMP_NUM_THREADS set by the user is kept.
+
+#ifndef NPROCS_SHIM
+    #define NPROCS_SHIM "output/nprocs.so"
+#endif
+
+// Warn once if the shim is not built
+void nprocs_check(void) {
+    static int checked;
+    if (checked)
+        return;
+    checked = 1;
+
+    if (access(NPROCS_SHIM, R_OK) != 0)
+        fprintf(stderr, "Warning: %s is missing, programs sizing their thread pools from the online cpus ignore \"-cpus\".\n", NPROCS_SHIM);
+}
+
+// Export the size of cpus (in the child, before execv)
+void nprocs_child(const cpu_set_t *cpus) {
+    char num_threads[12];
+    snprintf(num_threads, sizeof num_threads, "%d", CPU_COUNT(cpus));
+    setenv("OMP_NUM_THREADS", num_threads, 0);
+
+    if (access(NPROCS_SHIM, R_OK) == 0)
+        preload_library(NPROCS_SHIM);
+}
+
+#endif // _NPROCS_H
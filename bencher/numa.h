@@ -0,0 +1,257 @@
+#ifndef _NUMA_H
+#define _NUMA_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include <linux/mempolicy.h>
+#include <sys/syscall.h>
+
+#include "affinity.h"
+
+// Memory placement on multi-socket hosts, set with set_mempolicy in the child
+// before execv (the policy is inherited across execv):
+//   local        only use the nodes of the benchmark cpus (MPOL_BIND)
+//   interleave   interleave pages over all nodes with memory
+//   bind-remote  only use the first node with memory and none of the
+//                benchmark cpus
+//   first-touch  the system default (MPOL_DEFAULT), allocate on the node of
+//                the cpu touching a page, falling back to other nodes
+// On single node machines, every policy is a no-op. Node lists have the same
+// format as cpu lists, so node sets are stored in cpu_set_t.
+
+#define NODE_DIR "/sys/devices/system/node"
+#define NODE_MEMORY NODE_DIR "/has_memory"
+#define NODE_CPUS NODE_DIR "/node%d/cpulist"
+#define NODE_STAT NODE_DIR "/node%d/numastat"
+#define NUMA_REPORT 8 // Nodes with a column of allocated memory
+#define NUMA_WATCH_MS 20
+
+enum NumaPolicy { NUMA_LOCAL, NUMA_INTERLEAVE, NUMA_BIND_REMOTE, NUMA_FIRST_TOUCH };
+const char *numa_names[] = { "local", "interleave", "bind-remote", "first-touch" };
+
+struct Numa {
+    int policy;
+    int mode;             // MPOL_*, -1 if nothing is applied
+    cpu_set_t nodes;      // Node mask of the mode
+    cpu_set_t memory;     // Nodes with memory
+    int report[NUMA_REPORT]; // Node of each column
+    int report_count;
+    char layout[512];     // "0:0-7 1:8-15", cpus of every node with memory
+    char applied[64];     // Policy as applied, e.g. "local 0"
+};
+
+// Policy by name, -1 if unknown
+int numa_policy(const char *name) {
+    for (int i = 0; i < (int) (sizeof numa_names / sizeof *numa_names); ++i)
+        if (strcmp(name, numa_names[i]) == 0)
+            return i;
+    return -1;
+}
+
+// Resolve policy for the benchmark cpus and describe the node layout
+void numa_init(struct Numa *numa, int policy, const cpu_set_t *cpus) {
+    numa->policy = policy;
+    numa->mode = -1;
+    numa->report_count = 0;
+    numa->layout[0] = 0;
+    CPU_ZERO(&numa->nodes);
+    CPU_ZERO(&numa->memory);
+
+    // Without sysfs, assume a single node
+    if (!read_cpu_list(NODE_MEMORY, &numa->memory))
+        CPU_SET(0, &numa->memory);
+
+    // Nodes with memory and their cpus, the first and first remote node
+    cpu_set_t local;
+    CPU_ZERO(&local);
+    int remote = -1;
+    size_t used = 0;
+    for (int node = 0; node < CPU_SETSIZE; ++node) {
+        if (!CPU_ISSET(node, &numa->memory))
+            continue;
+        if (numa->report_count < NUMA_REPORT)
+            numa->report[numa->report_count++] = node;
+
+        char filename[sizeof NODE_CPUS + 8];
+        snprintf(filename, sizeof filename, NODE_CPUS, node);
+        cpu_set_t node_cpus, shared;
+        CPU_ZERO(&node_cpus);
+        read_cpu_list(filename, &node_cpus);
+
+        CPU_AND(&shared, &node_cpus, cpus);
+        if (CPU_COUNT(&shared))
+            CPU_SET(node, &local);
+        else if (remote < 0)
+            remote = node;
+
+        char list[256];
+        format_cpus(&node_cpus, list, sizeof list);
+        if (used < sizeof numa->layout)
+            used += snprintf(numa->layout + used, sizeof numa->layout - used, "%s%d:%s", used ? " " : "", node, list[0] ? list : "-");
+    }
+
+    if (CPU_COUNT(&numa->memory) < 2) {
+        snprintf(numa->applied, sizeof numa->applied, "none (single node)");
+        return;
+    }
+
+    switch (policy) {
+        case NUMA_LOCAL:
+            if (!CPU_COUNT(&local)) {
+                snprintf(numa->applied, sizeof numa->applied, "none (no local node)");
+                break;
+            }
+            numa->mode = MPOL_BIND;
+            numa->nodes = local;
+            snprintf(numa->applied, sizeof numa->applied, "local ");
+            format_cpus(&numa->nodes, numa->applied + 6, sizeof numa->applied - 6);
+            break;
+        case NUMA_INTERLEAVE:
+            numa->mode = MPOL_INTERLEAVE;
+            numa->nodes = numa->memory;
+            snprintf(numa->applied, sizeof numa->applied, "interleave ");
+            format_cpus(&numa->nodes, numa->applied + 11, sizeof numa->applied - 11);
+            break;
+        case NUMA_BIND_REMOTE:
+            if (remote < 0) {
+                snprintf(numa->applied, sizeof numa->applied, "none (no remote node)");
+                break;
+            }
+            numa->mode = MPOL_BIND;
+            CPU_SET(remote, &numa->nodes);
+            snprintf(numa->applied, sizeof numa->applied, "bind-remote %d", remote);
+            break;
+        case NUMA_FIRST_TOUCH:
+            numa->mode = MPOL_DEFAULT;
+            snprintf(numa->applied, sizeof numa->applied, "first-touch");
+            break;
+    }
+}
+
+// Set the policy of the calling process (in the child, before execv). The
+// bits of cpu_set_t have the layout of a node mask.
+void numa_child(const struct Numa *numa) {
+    if (numa->mode < 0)
+        return;
+
+    const unsigned long *mask = numa->mode == MPOL_DEFAULT ? NULL : (const unsigned long *) &numa->nodes;
+    if (syscall(SYS_set_mempolicy, numa->mode, mask, mask ? CPU_SETSIZE + 1 : 0))
+        perror("set_mempolicy");
+}
+
+// Pages allocated on every reported node so far (system wide, numa_hit and
+// numa_miss), -1 if unknown
+void numa_pages(const struct Numa *numa, long *pages) {
+    for (int i = 0; i < numa->report_count; ++i) {
+        char filename[sizeof NODE_STAT + 8];
+        snprintf(filename, sizeof filename, NODE_STAT, numa->report[i]);
+
+        long hit = -1, miss = -1;
+        FILE *file = fopen(filename, "r");
+        if (file) {
+            if (fscanf(file, "numa_hit %ld numa_miss %ld", &hit, &miss) != 2)
+                hit = miss = -1;
+            fclose(file);
+        }
+        pages[i] = hit < 0 ? -1 : hit + miss;
+    }
+}
+
+// numastat is system wide and includes concurrent jobs of a campaign. Runs
+// with their own cgroup instead sample memory.numa_stat of the cgroup while
+// the child is running, recording the peak of anonymous memory per node. That
+// is resident memory, not allocated pages, but it only covers the benchmark.
+struct NumaWatch {
+    pthread_t thread;
+    int stop[2]; // closed by the parent to stop sampling
+    int fd;
+    const struct Numa *numa;
+    long *pages; // Peak per reported node
+};
+
+// Parse the "anon N0=<bytes> N1=<bytes>" line (the first one)
+void numa_watch_sample(struct NumaWatch *watch) {
+    char text[4096];
+    ssize_t length = pread(watch->fd, text, sizeof text - 1, 0);
+    if (length <= 0)
+        return;
+    text[length] = 0;
+    text[strcspn(text, "\n")] = 0;
+    if (strncmp(text, "anon ", 5) != 0)
+        return;
+
+    for (int i = 0; i < watch->numa->report_count; ++i) {
+        char key[16];
+        snprintf(key, sizeof key, " N%d=", watch->numa->report[i]);
+        const char *pos = strstr(text, key);
+        long pages = pos ? atol(pos + strlen(key)) / sysconf(_SC_PAGESIZE) : 0;
+        if (pages > watch->pages[i])
+            watch->pages[i] = pages;
+    }
+}
+
+void *numa_watch_main(void *arg) {
+    struct NumaWatch *watch = (struct NumaWatch *) arg;
+
+    struct pollfd stop = { watch->stop[0], POLLIN, 0 };
+    do {
+        numa_watch_sample(watch);
+    } while (poll(&stop, 1, NUMA_WATCH_MS) == 0);
+    return NULL;
+}
+
+// Start sampling the cgroup at path into pages until numa_watch_finish.
+// Returns 0 on error.
+int numa_watch_start(struct NumaWatch *watch, const struct Numa *numa, const char *path, const cpu_set_t *benchmark_cpus, long *pages) {
+    char filename[PATH_MAX + 32];
+    snprintf(filename, sizeof filename, "%s/memory.numa_stat", path);
+    watch->fd = open(filename, O_RDONLY | O_CLOEXEC);
+    if (watch->fd < 0)
+        return 0;
+
+    watch->numa = numa;
+    watch->pages = pages;
+    for (int i = 0; i < numa->report_count; ++i)
+        pages[i] = 0;
+
+    if (pipe2(watch->stop, O_CLOEXEC)) {
+        perror("pipe numa");
+        close(watch->fd);
+        return 0;
+    }
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+
+    cpu_set_t others;
+    if (other_cpus(benchmark_cpus, &others))
+        pthread_attr_setaffinity_np(&attr, sizeof others, &others);
+
+    int result = pthread_create(&watch->thread, &attr, numa_watch_main, watch);
+    pthread_attr_destroy(&attr);
+    if (result) {
+        fprintf(stderr, "Error: Could not start numa thread.\n");
+        close(watch->stop[0]);
+        close(watch->stop[1]);
+        close(watch->fd);
+        return 0;
+    }
+
+    return 1;
+}
+
+void numa_watch_finish(struct NumaWatch *watch) {
+    close(watch->stop[1]);
+    pthread_join(watch->thread, NULL);
+    close(watch->stop[0]);
+    close(watch->fd);
+}
+
+#endif // _NUMA_H
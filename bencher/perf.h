@@ -0,0 +1,97 @@
+#ifndef _PERF_H
+#define _PERF_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+
+#define PERF_DTLB_READ_MISS (PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16))
+
+struct PerfEvent {
+    const char *name;
+    uint32_t type;
+    uint64_t config;
+};
+
+const struct PerfEvent perf_events[] = {
+    { "cycles",    PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+    { "instr",     PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+    { "cacheref",  PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_REFERENCES },
+    { "cachemiss", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+    { "brmiss",    PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+    { "dtlbmiss",  PERF_TYPE_HW_CACHE, PERF_DTLB_READ_MISS },
+};
+#define PERF_EVENTS (sizeof perf_events / sizeof *perf_events)
+#define PERF_DTLB (PERF_EVENTS - 1) // Index of dtlbmiss
+
+struct Perf {
+    int fds[PERF_EVENTS];
+    // Counter values, scaled for multiplexing, -1 if not available
+    long long values[PERF_EVENTS];
+};
+
+long perf_event_open(struct perf_event_attr *attr, pid_t pid, int cpu, int group_fd, unsigned long flags) {
+    return syscall(SYS_perf_event_open, attr, pid, cpu, group_fd, flags);
+}
+
+// Attach a counter to a child which is waiting to call execv. Counting starts
+// at exec and is inherited by all threads and processes the child creates.
+// Returns -1 if the counter is not available.
+int perf_counter(const struct PerfEvent *event, pid_t pid) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof attr);
+    attr.size = sizeof attr;
+    attr.type = event->type;
+    attr.config = event->config;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    attr.disabled = 1;
+    attr.enable_on_exec = 1;
+    attr.inherit = 1;
+    // Allowed with the default perf_event_paranoid setting
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return perf_event_open(&attr, pid, -1, -1, PERF_FLAG_FD_CLOEXEC);
+}
+
+// Read and close a counter after the child has been reaped, scaled for
+// multiplexing. Returns -1 if not available.
+long long perf_value(int fd) {
+    if (fd < 0)
+        return -1;
+
+    long long value = -1;
+    uint64_t data[3]; // value, time enabled, time running
+    if (read(fd, data, sizeof data) == sizeof data && data[2] > 0)
+        value = (long long) ((long double) data[0] * data[1] / data[2]);
+    close(fd);
+    return value;
+}
+
+void perf_open(struct Perf *perf, pid_t pid) {
+    // Only complain once per counter, not for every iteration
+    static char warned[PERF_EVENTS];
+
+    // Not grouped: the U540 only has two programmable counters, a group of
+    // six would never be scheduled. Multiplexing is corrected in perf_read.
+    for (size_t i = 0; i < PERF_EVENTS; ++i) {
+        perf->fds[i] = perf_counter(&perf_events[i], pid);
+        if (perf->fds[i] < 0 && !warned[i]) {
+            fprintf(stderr, "Warning: Counter %s not available: ", perf_events[i].name);
+            perror(NULL);
+            warned[i] = 1;
+        }
+    }
+}
+
+void perf_read(struct Perf *perf) {
+    for (size_t i = 0; i < PERF_EVENTS; ++i) {
+        perf->values[i] = perf_value(perf->fds[i]);
+        perf->fds[i] = -1;
+    }
+}
+
+#endif // _PERF_H
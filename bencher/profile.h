@@ -0,0 +1,429 @@
+#ifndef _PROFILE_H
+#define _PROFILE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <limits.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include <sys/mman.h>
+
+#include "perf.h"
+#include "digest.h"
+#include "symbols.h"
+#include "affinity.h"
+
+// Sampling profiler: a perf event samples the child (and everything it
+// creates) with user space call chains into a ring buffer, which a separate
+// thread drains while the child is running. After each run, stacks are
+// symbolized against the binary and summed up over all runs as folded stacks
+// ("<thread>;<outermost>;...;<innermost> <count>"), one root per thread.
+// Call chains are unwound using frame pointers. Inherited events can't be
+// mapped per task, so there is one event and ring buffer per benchmark cpu.
+
+#define PROFILE_PAGES 64 // Data pages of the ring buffer, power of two
+#define PROFILE_FRAME 256
+
+// Byte string keys with counts, open addressing
+struct CountEntry {
+    uint64_t hash;
+    char *key;
+    size_t length;
+    long count;
+};
+
+struct Counts {
+    struct CountEntry *entries;
+    size_t capacity, used;
+};
+
+void counts_add(struct Counts *counts, const void *key, size_t length, long count) {
+    // Keep at most half full
+    if (2 * (counts->used + 1) > counts->capacity) {
+        struct Counts grown = { NULL, counts->capacity ? 2 * counts->capacity : 1024, 0 };
+        grown.entries = (struct CountEntry *) calloc(grown.capacity, sizeof(struct CountEntry));
+        for (size_t i = 0; i < counts->capacity; ++i) {
+            struct CountEntry *entry = &counts->entries[i];
+            if (!entry->key)
+                continue;
+            size_t slot = entry->hash & (grown.capacity - 1);
+            while (grown.entries[slot].key)
+                slot = (slot + 1) & (grown.capacity - 1);
+            grown.entries[slot] = *entry;
+        }
+        grown.used = counts->used;
+        free(counts->entries);
+        *counts = grown;
+    }
+
+    uint64_t hash = digest_block((const char *) key, length);
+    size_t slot = hash & (counts->capacity - 1);
+    for (;; slot = (slot + 1) & (counts->capacity - 1)) {
+        struct CountEntry *entry = &counts->entries[slot];
+        if (!entry->key) {
+            entry->hash = hash;
+            entry->key = (char *) malloc(length);
+            memcpy(entry->key, key, length);
+            entry->length = length;
+            entry->count = count;
+            ++counts->used;
+            return;
+        }
+        if (entry->hash == hash && entry->length == length && memcmp(entry->key, key, length) == 0) {
+            entry->count += count;
+            return;
+        }
+    }
+}
+
+void counts_clear(struct Counts *counts) {
+    for (size_t i = 0; i < counts->capacity; ++i)
+        free(counts->entries[i].key);
+    free(counts->entries);
+    memset(counts, 0, sizeof *counts);
+}
+
+// Executable mapping of the child, from PERF_RECORD_MMAP
+struct Mapping {
+    uint64_t start, end, offset;
+    int binary;
+    char name[64];
+};
+
+// Thread name, from PERF_RECORD_COMM
+struct Comm {
+    uint32_t tid;
+    char name[16];
+};
+
+struct Profile {
+    // Over all runs
+    int frequency;
+    FILE *file;
+    char binary[PATH_MAX];
+    struct Symbols symbols;
+    int has_symbols; // 1 if loaded, -1 if loading failed
+    struct Counts folded;
+    long lost;
+
+    // Current run
+    int *fds;
+    char **rings;
+    int ring_count;
+    size_t ring_length;
+    uint32_t pid;
+    pthread_t thread;
+    int stop[2];
+    struct Counts stacks; // Keys: tid and call chain
+    struct Mapping *mappings;
+    size_t mapping_count;
+    struct Comm *comms;
+    size_t comm_count;
+};
+
+// Handle one record from the ring buffer
+void profile_record(struct Profile *profile, const struct perf_event_header *header) {
+    const char *body = (const char *) (header + 1);
+
+    if (header->type == PERF_RECORD_SAMPLE) {
+        // ip, pid, tid, nr, ips[nr]
+        uint32_t tid;
+        uint64_t nr;
+        memcpy(&tid, body + 12, sizeof tid);
+        memcpy(&nr, body + 16, sizeof nr);
+
+        // Key: tid, then return addresses without context markers
+        uint64_t key[PERF_MAX_STACK_DEPTH + 1];
+        size_t length = 0;
+        key[length++] = tid;
+        for (uint64_t i = 0; i < nr && length <= PERF_MAX_STACK_DEPTH; ++i) {
+            uint64_t ip;
+            memcpy(&ip, body + 24 + i * sizeof ip, sizeof ip);
+            if (ip < PERF_CONTEXT_MAX)
+                key[length++] = ip;
+        }
+        counts_add(&profile->stacks, key, length * sizeof *key, 1);
+    } else if (header->type == PERF_RECORD_MMAP) {
+        // pid, tid, addr, len, pgoff, filename
+        struct Mapping mapping;
+        uint64_t length;
+        memcpy(&mapping.start, body + 8, sizeof mapping.start);
+        memcpy(&length, body + 16, sizeof length);
+        memcpy(&mapping.offset, body + 24, sizeof mapping.offset);
+        mapping.end = mapping.start + length;
+
+        const char *filename = body + 32;
+        mapping.binary = strcmp(filename, profile->binary) == 0;
+        const char *base = strrchr(filename, '/');
+        snprintf(mapping.name, sizeof mapping.name, "[%s]", base ? base + 1 : filename);
+
+        profile->mappings = (struct Mapping *) realloc(profile->mappings, sizeof(struct Mapping) * (profile->mapping_count + 1));
+        profile->mappings[profile->mapping_count++] = mapping;
+    } else if (header->type == PERF_RECORD_COMM) {
+        // pid, tid, comm
+        struct Comm comm;
+        memcpy(&comm.tid, body + 4, sizeof comm.tid);
+        snprintf(comm.name, sizeof comm.name, "%s", body + 8);
+
+        profile->comms = (struct Comm *) realloc(profile->comms, sizeof(struct Comm) * (profile->comm_count + 1));
+        profile->comms[profile->comm_count++] = comm;
+    } else if (header->type == PERF_RECORD_LOST) {
+        // id, lost
+        uint64_t lost;
+        memcpy(&lost, body + 8, sizeof lost);
+        profile->lost += lost;
+    }
+}
+
+// Consume all records in a ring buffer
+void profile_drain(struct Profile *profile, char *ring) {
+    struct perf_event_mmap_page *meta = (struct perf_event_mmap_page *) ring;
+    const char *data = ring + meta->data_offset;
+    uint64_t size = meta->data_size;
+
+    uint64_t head = __atomic_load_n(&meta->data_head, __ATOMIC_ACQUIRE);
+    uint64_t tail = meta->data_tail;
+
+    // Records can wrap around the end of the buffer
+    static char record[UINT16_MAX + 1];
+    while (tail < head) {
+        struct perf_event_header header;
+        for (size_t i = 0; i < sizeof header; ++i)
+            ((char *) &header)[i] = data[(tail + i) % size];
+        for (size_t i = 0; i < header.size; ++i)
+            record[i] = data[(tail + i) % size];
+
+        profile_record(profile, (const struct perf_event_header *) record);
+        tail += header.size;
+    }
+
+    __atomic_store_n(&meta->data_tail, tail, __ATOMIC_RELEASE);
+}
+
+void *profile_main(void *arg) {
+    struct Profile *profile = (struct Profile *) arg;
+
+    // Woken up when a buffer is a quarter full
+    struct pollfd *fds = (struct pollfd *) calloc(profile->ring_count + 1, sizeof(struct pollfd));
+    fds[0].fd = profile->stop[0];
+    fds[0].events = POLLIN;
+    for (int i = 0; i < profile->ring_count; ++i) {
+        fds[i + 1].fd = profile->fds[i];
+        fds[i + 1].events = POLLIN;
+    }
+
+    while (poll(fds, profile->ring_count + 1, -1) >= 0 && !fds[0].revents)
+        for (int i = 0; i < profile->ring_count; ++i)
+            if (fds[i + 1].revents)
+                profile_drain(profile, profile->rings[i]);
+
+    free(fds);
+    return NULL;
+}
+
+// Unmap and close the rings of the current run
+void profile_close(struct Profile *profile) {
+    for (int i = 0; i < profile->ring_count; ++i) {
+        munmap(profile->rings[i], profile->ring_length);
+        close(profile->fds[i]);
+    }
+    free(profile->rings);
+    free(profile->fds);
+    profile->rings = NULL;
+    profile->fds = NULL;
+    profile->ring_count = 0;
+}
+
+// Attach the sampling events to a child which is waiting to call execv and
+// start draining it. The thread avoids the benchmark cpus if there are any
+// others. Returns 0 on error.
+int profile_open(struct Profile *profile, pid_t pid, const char *binary, const cpu_set_t *benchmark_cpus) {
+    // Only complain once, not for every iteration
+    static int warned;
+
+    if (!realpath(binary, profile->binary))
+        snprintf(profile->binary, sizeof profile->binary, "%s", binary);
+
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof attr);
+    attr.size = sizeof attr;
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = PERF_COUNT_HW_CPU_CYCLES;
+    attr.sample_freq = profile->frequency;
+    attr.freq = 1;
+    attr.sample_type = PERF_SAMPLE_IP | PERF_SAMPLE_TID | PERF_SAMPLE_CALLCHAIN;
+    attr.disabled = 1;
+    attr.enable_on_exec = 1;
+    attr.inherit = 1;
+    attr.mmap = 1;
+    attr.comm = 1;
+    attr.watermark = 1;
+    attr.wakeup_watermark = PROFILE_PAGES / 4 * sysconf(_SC_PAGESIZE);
+    // Allowed with the default perf_event_paranoid setting
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.exclude_callchain_kernel = 1;
+
+    // Metadata page followed by the data pages
+    profile->ring_length = (PROFILE_PAGES + 1) * sysconf(_SC_PAGESIZE);
+    profile->fds = (int *) malloc(sizeof(int) * CPU_COUNT(benchmark_cpus));
+    profile->rings = (char **) malloc(sizeof(char *) * CPU_COUNT(benchmark_cpus));
+    profile->ring_count = 0;
+
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+        if (!CPU_ISSET(cpu, benchmark_cpus))
+            continue;
+
+        // Fall back to a timer without hardware counters
+        int fd = perf_event_open(&attr, pid, cpu, -1, PERF_FLAG_FD_CLOEXEC);
+        if (fd < 0 && attr.type == PERF_TYPE_HARDWARE) {
+            attr.type = PERF_TYPE_SOFTWARE;
+            attr.config = PERF_COUNT_SW_TASK_CLOCK;
+            fd = perf_event_open(&attr, pid, cpu, -1, PERF_FLAG_FD_CLOEXEC);
+        }
+        if (fd < 0) {
+            if (!warned) {
+                perror("Warning: Profiling not available");
+                warned = 1;
+            }
+            profile_close(profile);
+            return 0;
+        }
+
+        char *ring = (char *) mmap(NULL, profile->ring_length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (ring == MAP_FAILED) {
+            perror("mmap profile");
+            close(fd);
+            profile_close(profile);
+            return 0;
+        }
+
+        profile->fds[profile->ring_count] = fd;
+        profile->rings[profile->ring_count++] = ring;
+    }
+
+    profile->pid = pid;
+    if (pipe2(profile->stop, O_CLOEXEC)) {
+        perror("pipe profile");
+        profile_close(profile);
+        return 0;
+    }
+
+    pthread_attr_t thread_attr;
+    pthread_attr_init(&thread_attr);
+
+    cpu_set_t others;
+    if (other_cpus(benchmark_cpus, &others))
+        pthread_attr_setaffinity_np(&thread_attr, sizeof others, &others);
+
+    int result = pthread_create(&profile->thread, &thread_attr, profile_main, profile);
+    pthread_attr_destroy(&thread_attr);
+    if (result) {
+        fprintf(stderr, "Error: Could not start profile thread.\n");
+        close(profile->stop[0]);
+        close(profile->stop[1]);
+        profile_close(profile);
+        return 0;
+    }
+
+    return 1;
+}
+
+// Name of a frame, written to buffer
+void profile_frame(struct Profile *profile, uint64_t ip, char *buffer, size_t length) {
+    for (size_t i = profile->mapping_count; i-- > 0;) {
+        const struct Mapping *mapping = &profile->mappings[i];
+        if (ip < mapping->start || ip >= mapping->end)
+            continue;
+
+        const char *name = NULL;
+        if (mapping->binary && profile->has_symbols > 0)
+            name = symbols_find(&profile->symbols, ip - mapping->start + mapping->offset);
+        snprintf(buffer, length, "%s", name ? name : mapping->name);
+        return;
+    }
+
+    snprintf(buffer, length, "[unknown]");
+}
+
+// Name of a thread: its name and the distance of its id to the child's. Ids
+// are usually allocated in order, so this is the order of creation.
+void profile_thread(struct Profile *profile, uint32_t tid, char *buffer, size_t length) {
+    const char *name = NULL;
+    for (size_t i = 0; i < profile->comm_count; ++i)
+        if (profile->comms[i].tid == tid || (!name && profile->comms[i].tid == profile->pid))
+            name = profile->comms[i].name;
+
+    const char *base = strrchr(profile->binary, '/');
+    snprintf(buffer, length, "%.64s-%d", name ? name : base ? base + 1 : profile->binary, (int) (tid - profile->pid));
+}
+
+// Stop draining after the child has exited, fold and symbolize its stacks
+void profile_finish(struct Profile *profile) {
+    close(profile->stop[1]);
+    pthread_join(profile->thread, NULL);
+    close(profile->stop[0]);
+
+    for (int i = 0; i < profile->ring_count; ++i)
+        profile_drain(profile, profile->rings[i]);
+    profile_close(profile);
+
+    // Symbols are loaded once, all runs use the same binary
+    if (!profile->has_symbols)
+        profile->has_symbols = symbols_load(&profile->symbols, profile->binary) ? 1 : -1;
+
+    size_t capacity = 4096;
+    char *folded = (char *) malloc(capacity);
+    for (size_t i = 0; i < profile->stacks.capacity; ++i) {
+        const struct CountEntry *entry = &profile->stacks.entries[i];
+        if (!entry->key)
+            continue;
+
+        const uint64_t *key = (const uint64_t *) entry->key;
+        size_t depth = entry->length / sizeof *key;
+
+        // Thread, then outermost to innermost frame
+        char frame[PROFILE_FRAME];
+        profile_thread(profile, key[0], frame, sizeof frame);
+        size_t used = snprintf(folded, capacity, "%s", frame);
+        for (size_t j = depth - 1; j > 0; --j) {
+            profile_frame(profile, key[j], frame, sizeof frame);
+            if (used + strlen(frame) + 2 > capacity)
+                folded = (char *) realloc(folded, capacity *= 2);
+            used += sprintf(folded + used, ";%s", frame);
+        }
+
+        counts_add(&profile->folded, folded, used, entry->count);
+    }
+    free(folded);
+
+    counts_clear(&profile->stacks);
+    free(profile->mappings);
+    profile->mappings = NULL;
+    profile->mapping_count = 0;
+    free(profile->comms);
+    profile->comms = NULL;
+    profile->comm_count = 0;
+}
+
+// Append folded stacks of all runs to the profile file
+void profile_write(struct Profile *profile) {
+    if (profile->lost)
+        fprintf(stderr, "Warning: Profile lost %ld samples.\n", profile->lost);
+
+    for (size_t i = 0; i < profile->folded.capacity; ++i) {
+        const struct CountEntry *entry = &profile->folded.entries[i];
+        if (entry->key)
+            fprintf(profile->file, "%.*s %ld\n", (int) entry->length, entry->key, entry->count);
+    }
+
+    counts_clear(&profile->folded);
+    symbols_free(&profile->symbols);
+}
+
+#endif // _PROFILE_H
@@ -0,0 +1,189 @@
+#ifndef _SAMPLER_H
+#define _SAMPLER_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sched.h>
+#include <pthread.h>
+
+#include "affinity.h"
+
+// Memory and thread timeline of the child, sampled from /proc by a separate
+// thread while it is running. All memory values are in KiB.
+//
+// Sample file format (text), per benchmark:
+//   <title>
+//   run  time  rss  anon  file  shmem  pss  swap  threads  user  system
+//   <one line per sample>
+
+#define SAMPLE_FIELDS 7
+const char *sample_columns[] = { "run", "time", "rss", "anon", "file", "shmem", "pss", "swap", "threads", "user", "system" };
+
+// Sample file shared by all runs
+struct SampleLog {
+    FILE *file;
+    int interval_ms;
+    int runs;
+};
+
+// Samples a single run
+struct Sampler {
+    pthread_t thread;
+    int dir;     // /proc/<pid>, stays valid (but empty) after the pid is reused
+    int stop[2]; // closed by the parent to stop sampling
+    const volatile struct timespec *exec;
+    struct SampleLog *log;
+    int run;
+};
+
+// Start a new table in the sample file
+void sample_title(struct SampleLog *log, const char *title) {
+    fprintf(log->file, "%s\n", title);
+    for (size_t i = 0; i < sizeof sample_columns / sizeof *sample_columns; ++i)
+        fprintf(log->file, i ? "  %-7s" : "%-7s", sample_columns[i]);
+    fprintf(log->file, "\n");
+    log->runs = 0;
+}
+
+// Read a small file from /proc into buffer, returns 0 on error
+int read_proc(int dir, const char *name, char *buffer, size_t length) {
+    int fd = openat(dir, name, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return 0;
+
+    ssize_t read_bytes = read(fd, buffer, length - 1);
+    close(fd);
+    if (read_bytes <= 0)
+        return 0;
+
+    buffer[read_bytes] = 0;
+    return 1;
+}
+
+// Value of a "<key>: <value>" line, -1 if not present
+long proc_field(const char *text, const char *key) {
+    size_t key_length = strlen(key);
+    for (const char *line = text; line; line = strchr(line, '\n')) {
+        if (*line == '\n')
+            ++line;
+        if (strncmp(line, key, key_length) == 0 && line[key_length] == ':')
+            return atol(line + key_length + 1);
+    }
+    return -1;
+}
+
+// Write one sample, returns 0 once the process has exited
+int sample(struct Sampler *sampler, const struct timespec *now) {
+    char status[4096], rollup[4096], stat[1024];
+    if (!read_proc(sampler->dir, "status", status, sizeof status))
+        return 0;
+
+    // Zombies have no memory left
+    long values[SAMPLE_FIELDS] = {
+        proc_field(status, "VmRSS"),
+        proc_field(status, "RssAnon"),
+        proc_field(status, "RssFile"),
+        proc_field(status, "RssShmem"),
+        -1, -1,
+        proc_field(status, "Threads"),
+    };
+    if (values[0] < 0)
+        return 0;
+
+    // Proportional set size is only available from smaps, which is slower
+    if (read_proc(sampler->dir, "smaps_rollup", rollup, sizeof rollup)) {
+        values[4] = proc_field(rollup, "Pss");
+        values[5] = proc_field(rollup, "Swap");
+    }
+
+    // CPU time of all threads, fields after the parenthesized command name
+    unsigned long utime = 0, stime = 0;
+    char *fields;
+    if (read_proc(sampler->dir, "stat", stat, sizeof stat) && (fields = strrchr(stat, ')')))
+        sscanf(fields + 1, " %*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu", &utime, &stime);
+    double ticks = sysconf(_SC_CLK_TCK);
+
+    double time = (now->tv_sec - sampler->exec->tv_sec) + (now->tv_nsec - sampler->exec->tv_nsec) / 1e9;
+    fprintf(sampler->log->file, "%7d  %7.3f", sampler->run, time);
+    for (int i = 0; i < SAMPLE_FIELDS; ++i) {
+        if (values[i] < 0)
+            fprintf(sampler->log->file, "  %7s", "-");
+        else
+            fprintf(sampler->log->file, "  %7ld", values[i]);
+    }
+    fprintf(sampler->log->file, "  %7.2f  %7.2f\n", utime / ticks, stime / ticks);
+
+    return 1;
+}
+
+void *sampler_main(void *arg) {
+    struct Sampler *sampler = (struct Sampler *) arg;
+
+    struct pollfd stop = { sampler->stop[0], POLLIN, 0 };
+    int running = 1;
+    do {
+        // Samples before execv would show the forked copy of bencher
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if (running && sampler->exec->tv_sec)
+            running = sample(sampler, &now);
+    } while (poll(&stop, 1, running ? sampler->log->interval_ms : -1) == 0);
+
+    return NULL;
+}
+
+// Start sampling pid until sampler_finish, exec is written by the child just
+// before execv. The thread avoids the benchmark cpus if there are any others.
+int sampler_start(struct Sampler *sampler, pid_t pid, struct SampleLog *log, const volatile struct timespec *exec, const cpu_set_t *benchmark_cpus) {
+    char path[32];
+    snprintf(path, sizeof path, "/proc/%d", pid);
+    sampler->dir = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (sampler->dir < 0) {
+        perror(path);
+        return 0;
+    }
+
+    if (pipe2(sampler->stop, O_CLOEXEC)) {
+        perror("pipe sampler");
+        close(sampler->dir);
+        return 0;
+    }
+
+    sampler->exec = exec;
+    sampler->log = log;
+    sampler->run = ++log->runs;
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+
+    cpu_set_t others;
+    if (other_cpus(benchmark_cpus, &others))
+        pthread_attr_setaffinity_np(&attr, sizeof others, &others);
+
+    int result = pthread_create(&sampler->thread, &attr, sampler_main, sampler);
+    pthread_attr_destroy(&attr);
+    if (result) {
+        fprintf(stderr, "Error: Could not start sampler thread.\n");
+        close(sampler->stop[0]);
+        close(sampler->stop[1]);
+        close(sampler->dir);
+        return 0;
+    }
+
+    return 1;
+}
+
+// Stop sampling and wait for the thread
+void sampler_finish(struct Sampler *sampler) {
+    close(sampler->stop[1]);
+    pthread_join(sampler->thread, NULL);
+    close(sampler->stop[0]);
+    close(sampler->dir);
+}
+
+#endif // _SAMPLER_H
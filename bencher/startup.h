@@ -0,0 +1,33 @@
+#ifndef _STARTUP_H
+#define _STARTUP_H
+
+#include <time.h>
+
+// Exec to main latency: benchmarks linked with output/startup.o (built from
+// startup.c) write the time just before main (CLOCK_MONOTONIC) as a struct
+// timespec to the file descriptor named by STARTUP_FD.
+
+#define STARTUP_FD "BENCHER_STARTUP_FD"
+
+#ifndef STARTUP_STAMP
+
+#include <stdio.h>
+#include <unistd.h>
+
+// Read the stamp after the benchmark exited, returns 0 if the benchmark is
+// not linked with the stamp
+int startup_read(int fd, struct timespec *main) {
+    if (pread(fd, main, sizeof *main, 0) == sizeof *main)
+        return 1;
+
+    static int warned;
+    if (!warned) {
+        fprintf(stderr, "Warning: No startup stamp, is the benchmark linked with output/startup.o?\n");
+        warned = 1;
+    }
+    return 0;
+}
+
+#endif // STARTUP_STAMP
+
+#endif // _STARTUP_H
@@ -0,0 +1,42 @@
+#ifndef _STATS_H
+#define _STATS_H
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+int compare_doubles(const void *a, const void *b) {
+    double x = *(const double *) a, y = *(const double *) b;
+    return (x > y) - (x < y);
+}
+
+// Sort a copy of the values, caller has to free the result
+double *sorted_copy(const double *values, int count) {
+    double *sorted = (double *) malloc(sizeof(double) * count);
+    memcpy(sorted, values, sizeof(double) * count);
+    qsort(sorted, count, sizeof(double), compare_doubles);
+    return sorted;
+}
+
+double median(const double *sorted, int count) {
+    if (count == 0)
+        return NAN;
+    if (count % 2)
+        return sorted[count / 2];
+    return (sorted[count / 2 - 1] + sorted[count / 2]) / 2;
+}
+
+// Relative half-width of the ~95% confidence interval of the median.
+// Uses order statistics, so no assumption is made about the distribution of
+// run times. Needs at least 8 values, returns INFINITY for fewer.
+double median_rel_ci(const double *sorted, int count) {
+    double offset = 1.96 * sqrt(count) / 2;
+    int lower = (int) floor(count / 2.0 - offset); // 1-based ranks
+    int upper = (int) ceil(count / 2.0 + offset);
+    if (lower < 1 || upper > count)
+        return INFINITY;
+
+    return (sorted[upper - 1] - sorted[lower - 1]) / (2 * median(sorted, count));
+}
+
+#endif // _STATS_H
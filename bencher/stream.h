@@ -0,0 +1,81 @@
+#ifndef _STREAM_H
+#define _STREAM_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sched.h>
+#include <pthread.h>
+
+#include "affinity.h"
+#include "diff.h"
+
+// Pipe capacity for streamed output, the default 64 KiB would make the
+// benchmark wait for the verifier more often
+#define STREAM_PIPE_SIZE (1024 * 1024)
+
+// Verifies the output of the child on a separate thread while it is running
+struct Verifier {
+    pthread_t thread;
+    FILE *file;
+    const struct Diff *diff;
+
+    // Results
+    int ok;
+    struct timespec cpu_time;
+};
+
+void *verifier_main(void *arg) {
+    struct Verifier *verifier = (struct Verifier *) arg;
+
+    verifier->ok = check_output(verifier->file, verifier->diff);
+
+    // Drain whatever was not consumed, so the child never blocks on a full pipe
+    char buffer[4096];
+    while (fread(buffer, 1, sizeof buffer, verifier->file) > 0);
+
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &verifier->cpu_time);
+    fclose(verifier->file);
+    return NULL;
+}
+
+// Start verifying the read end of a pipe. The thread avoids the benchmark cpus
+// if there are any others.
+int verifier_start(struct Verifier *verifier, int fd, const struct Diff *diff, const cpu_set_t *benchmark_cpus) {
+    fcntl(fd, F_SETPIPE_SZ, STREAM_PIPE_SIZE);
+
+    verifier->file = fdopen(fd, "r");
+    verifier->diff = diff;
+    verifier->ok = 0;
+    if (!verifier->file) {
+        perror("fdopen");
+        return 0;
+    }
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+
+    cpu_set_t others;
+    if (other_cpus(benchmark_cpus, &others))
+        pthread_attr_setaffinity_np(&attr, sizeof others, &others);
+
+    int result = pthread_create(&verifier->thread, &attr, verifier_main, verifier);
+    pthread_attr_destroy(&attr);
+    if (result) {
+        fprintf(stderr, "Error: Could not start verifier thread.\n");
+        fclose(verifier->file);
+        return 0;
+    }
+
+    return 1;
+}
+
+// Wait for the verifier to finish, returns its result
+int verifier_finish(struct Verifier *verifier) {
+    pthread_join(verifier->thread, NULL);
+    return verifier->ok;
+}
+
+#endif // _STREAM_H
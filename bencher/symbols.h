@@ -0,0 +1,121 @@
+#ifndef _SYMBOLS_H
+#define _SYMBOLS_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <elf.h>
+#include <link.h>
+
+#include "fileutils.h"
+
+// Function symbols of an ELF file of the native word size, to map sampled
+// addresses to names. Uses .symtab, or .dynsym for stripped binaries.
+
+struct Symbol {
+    uint64_t address;
+    uint64_t size;
+    const char *name; // points into the mapped file
+};
+
+struct Symbols {
+    char *file;
+    size_t length;
+    const ElfW(Phdr) *segments;
+    int segment_count;
+    struct Symbol *symbols;
+    size_t count;
+};
+
+int compare_symbols(const void *a, const void *b) {
+    uint64_t x = ((const struct Symbol *) a)->address, y = ((const struct Symbol *) b)->address;
+    return (x > y) - (x < y);
+}
+
+void symbols_free(struct Symbols *symbols) {
+    free(symbols->symbols);
+    unmap_file(symbols->file, symbols->length);
+    memset(symbols, 0, sizeof *symbols);
+}
+
+// Collect function symbols of one symbol table section
+void symbols_add_table(struct Symbols *symbols, const ElfW(Shdr) *sections, const ElfW(Shdr) *table) {
+    const ElfW(Sym) *entries = (const ElfW(Sym) *) (symbols->file + table->sh_offset);
+    const char *strings = symbols->file + sections[table->sh_link].sh_offset;
+    size_t count = table->sh_size / sizeof(ElfW(Sym));
+
+    symbols->symbols = (struct Symbol *) realloc(symbols->symbols, sizeof(struct Symbol) * (symbols->count + count));
+    for (size_t i = 0; i < count; ++i) {
+        if (ELF32_ST_TYPE(entries[i].st_info) != STT_FUNC || entries[i].st_value == 0)
+            continue;
+
+        struct Symbol *symbol = &symbols->symbols[symbols->count++];
+        symbol->address = entries[i].st_value;
+        symbol->size = entries[i].st_size;
+        symbol->name = strings + entries[i].st_name;
+    }
+}
+
+// Load symbols of filename, returns 0 on error
+int symbols_load(struct Symbols *symbols, const char *filename) {
+    memset(symbols, 0, sizeof *symbols);
+    symbols->file = map_file(filename, &symbols->length);
+    if (!symbols->file)
+        return 0;
+
+    const ElfW(Ehdr) *header = (const ElfW(Ehdr) *) symbols->file;
+    if (symbols->length < sizeof *header || memcmp(header->e_ident, ELFMAG, SELFMAG) != 0
+            || header->e_ident[EI_CLASS] != (sizeof(void *) == 8 ? ELFCLASS64 : ELFCLASS32)) {
+        fprintf(stderr, "Warning: %s is not a native ELF file, can't symbolize.\n", filename);
+        symbols_free(symbols);
+        return 0;
+    }
+
+    symbols->segments = (const ElfW(Phdr) *) (symbols->file + header->e_phoff);
+    symbols->segment_count = header->e_phnum;
+
+    // Prefer the full symbol table
+    const ElfW(Shdr) *sections = (const ElfW(Shdr) *) (symbols->file + header->e_shoff);
+    for (int type = SHT_SYMTAB; !symbols->count && type; type = type == SHT_SYMTAB ? SHT_DYNSYM : 0)
+        for (int i = 0; i < header->e_shnum; ++i)
+            if (sections[i].sh_type == (unsigned) type)
+                symbols_add_table(symbols, sections, &sections[i]);
+
+    qsort(symbols->symbols, symbols->count, sizeof(struct Symbol), compare_symbols);
+    return 1;
+}
+
+// Name of the function containing the file offset, NULL if there is none
+const char *symbols_find(const struct Symbols *symbols, uint64_t offset) {
+    // File offset to virtual address of the loaded segment
+    uint64_t address = 0;
+    int found = 0;
+    for (int i = 0; !found && i < symbols->segment_count; ++i) {
+        const ElfW(Phdr) *segment = &symbols->segments[i];
+        if (segment->p_type == PT_LOAD && offset >= segment->p_offset && offset < segment->p_offset + segment->p_filesz) {
+            address = offset - segment->p_offset + segment->p_vaddr;
+            found = 1;
+        }
+    }
+
+    // Last symbol starting at or before address
+    size_t low = 0, high = symbols->count;
+    while (found && low < high) {
+        size_t mid = (low + high) / 2;
+        if (symbols->symbols[mid].address <= address)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+    if (!found || low == 0)
+        return NULL;
+
+    const struct Symbol *symbol = &symbols->symbols[low - 1];
+    if (symbol->size && address >= symbol->address + symbol->size)
+        return NULL;
+    return symbol->name;
+}
+
+#endif // _SYMBOLS_H
@@ -0,0 +1,358 @@
+// Thread caching size class allocator, preloaded by "bencher -allocators".
+// Small requests are served from per thread free lists, which are refilled
+// from and returned to central lists in batches. Blocks of a size class are
+// carved on demand from 1 MiB spans, the span header stores the class, so free
+// only has to round the pointer down. Large requests are mapped directly.
+#define _GNU_SOURCE
+
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include <sys/mman.h>
+
+#define SPAN_SIZE (1024 * 1024)
+#define SPAN_HEADER 64
+#define ARENA_SIZE (64 * 1024 * 1024) // Spans are taken from larger mappings
+#define MAX_SMALL (256 * 1024)
+#define CLASSES 52 // 16 byte steps up to 128, then four per power of two
+#define BATCH 32   // Blocks moved between thread cache and central list
+
+struct Span {
+	int cls;       // -1 for large blocks
+	size_t length; // Mapped length of large blocks
+};
+
+struct Block {
+	struct Block *next;
+};
+
+struct Cache {
+	struct Block *free[CLASSES];
+	int count[CLASSES];
+};
+
+struct Central {
+	pthread_mutex_t lock;
+	struct Block *free;
+	char *next, *end; // Not yet used part of the current span
+};
+
+// Zeroed mutexes are unlocked, malloc is called before constructors run
+static struct Central central[CLASSES];
+static pthread_mutex_t arena_lock = PTHREAD_MUTEX_INITIALIZER;
+static char *arena, *arena_end;
+static pthread_key_t cache_key;
+static int has_key;
+
+// Initial-exec TLS does not allocate
+static __thread struct Cache *cache __attribute__((tls_model("initial-exec")));
+
+static int size_class(size_t size) {
+	if (size <= 128)
+		return size ? (size - 1) / 16 : 0;
+	int shift = 63 - __builtin_clzl(size - 1);
+	return 8 + (shift - 7) * 4 + ((size - 1) >> (shift - 2)) - 4;
+}
+
+static size_t class_size(int cls) {
+	if (cls < 8)
+		return (cls + 1) * 16;
+	int step = cls - 8;
+	return (size_t) (5 + step % 4) << (5 + step / 4);
+}
+
+static struct Span *span_of(const void *ptr) {
+	return (struct Span *) ((uintptr_t) ptr & ~(uintptr_t) (SPAN_SIZE - 1));
+}
+
+// Map length bytes starting at a span boundary
+static char *map_aligned(size_t length) {
+	size_t page = sysconf(_SC_PAGESIZE);
+	length = (length + page - 1) & ~(page - 1);
+	char *map = (char *) mmap(NULL, length + SPAN_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (map == MAP_FAILED)
+		return NULL;
+
+	char *start = (char *) (((uintptr_t) map + SPAN_SIZE - 1) & ~(uintptr_t) (SPAN_SIZE - 1));
+	if (start > map)
+		munmap(map, start - map);
+	munmap(start + length, map + SPAN_SIZE - start);
+	return start;
+}
+
+// Space for blocks of a size class
+static struct Span *new_span(int cls) {
+	pthread_mutex_lock(&arena_lock);
+	if (arena == arena_end) {
+		arena = map_aligned(ARENA_SIZE);
+		arena_end = arena ? arena + ARENA_SIZE : NULL;
+	}
+	struct Span *span = (struct Span *) arena;
+	if (arena)
+		arena += SPAN_SIZE;
+	pthread_mutex_unlock(&arena_lock);
+	if (!span)
+		return NULL;
+
+	span->cls = cls;
+	return span;
+}
+
+// Up to BATCH blocks from the current span of the class, called with its lock
+static struct Block *carve(int cls, int *count) {
+	struct Central *list = &central[cls];
+	size_t size = class_size(cls);
+	if (list->next + size > list->end) {
+		struct Span *span = new_span(cls);
+		if (!span)
+			return NULL;
+		list->next = (char *) span + SPAN_HEADER;
+		list->end = (char *) span + SPAN_SIZE;
+	}
+
+	struct Block *first = (struct Block *) list->next, *last = NULL;
+	for (*count = 0; *count < BATCH && list->next + size <= list->end; ++*count) {
+		if (last)
+			last->next = (struct Block *) list->next;
+		last = (struct Block *) list->next;
+		list->next += size;
+	}
+	last->next = NULL;
+	return first;
+}
+
+// Give the blocks of a thread back when it exits
+static void flush_cache(void *arg) {
+	struct Cache *exiting = (struct Cache *) arg;
+	for (int cls = 0; cls < CLASSES; ++cls) {
+		struct Block *list = exiting->free[cls];
+		while (list) {
+			struct Block *next = list->next;
+			pthread_mutex_lock(&central[cls].lock);
+			list->next = central[cls].free;
+			central[cls].free = list;
+			pthread_mutex_unlock(&central[cls].lock);
+			list = next;
+		}
+	}
+	if (cache == exiting)
+		cache = NULL;
+	munmap(exiting, sizeof *exiting);
+}
+
+// The main thread does not need to flush its cache
+__attribute__((constructor)) static void init(void) {
+	has_key = pthread_key_create(&cache_key, flush_cache) == 0;
+}
+
+static struct Cache *thread_cache(void) {
+	if (!cache) {
+		void *map = mmap(NULL, sizeof *cache, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (map == MAP_FAILED)
+			return NULL;
+		cache = (struct Cache *) map;
+		if (has_key)
+			pthread_setspecific(cache_key, cache);
+	}
+	return cache;
+}
+
+static void *alloc_small(int cls) {
+	struct Cache *own = thread_cache();
+	if (!own)
+		return NULL;
+
+	// Refill from the central list, or from a new span
+	if (!own->free[cls]) {
+		pthread_mutex_lock(&central[cls].lock);
+		struct Block *list = central[cls].free, *last = NULL;
+		int count = 0;
+		for (struct Block *block = list; block && count < BATCH; block = block->next) {
+			last = block;
+			++count;
+		}
+		if (last) {
+			central[cls].free = last->next;
+			last->next = NULL;
+		} else {
+			list = carve(cls, &count);
+		}
+		pthread_mutex_unlock(&central[cls].lock);
+
+		own->free[cls] = list;
+		own->count[cls] = count;
+		if (!list)
+			return NULL;
+	}
+
+	struct Block *block = own->free[cls];
+	own->free[cls] = block->next;
+	--own->count[cls];
+	return block;
+}
+
+static void free_small(void *ptr, int cls) {
+	struct Cache *own = thread_cache();
+	struct Block *block = (struct Block *) ptr;
+	if (!own) {
+		pthread_mutex_lock(&central[cls].lock);
+		block->next = central[cls].free;
+		central[cls].free = block;
+		pthread_mutex_unlock(&central[cls].lock);
+		return;
+	}
+
+	block->next = own->free[cls];
+	own->free[cls] = block;
+
+	// Return a batch if the thread only frees
+	if (++own->count[cls] > 2 * BATCH) {
+		struct Block *first = own->free[cls], *last = first;
+		for (int i = 1; i < BATCH; ++i)
+			last = last->next;
+		own->free[cls] = last->next;
+		own->count[cls] -= BATCH;
+
+		pthread_mutex_lock(&central[cls].lock);
+		last->next = central[cls].free;
+		central[cls].free = first;
+		pthread_mutex_unlock(&central[cls].lock);
+	}
+}
+
+// Large blocks start offset bytes into their own mapping, behind the header
+static void *alloc_large(size_t size, size_t offset) {
+	if (size > SIZE_MAX - 2 * SPAN_SIZE) {
+		errno = ENOMEM;
+		return NULL;
+	}
+	size_t length = offset + size;
+	struct Span *span = (struct Span *) map_aligned(length);
+	if (!span) {
+		errno = ENOMEM;
+		return NULL;
+	}
+	span->cls = -1;
+	span->length = length;
+	return (char *) span + offset;
+}
+
+// Start of the block containing ptr (aligned allocations point into a block)
+static void *block_start(void *ptr, int cls) {
+	char *first = (char *) span_of(ptr) + SPAN_HEADER;
+	size_t size = class_size(cls);
+	return first + ((char *) ptr - first) / size * size;
+}
+
+// Not named malloc, GCC would turn malloc and memset in calloc into calloc
+static void *allocate(size_t size) {
+	if (size > MAX_SMALL)
+		return alloc_large(size, SPAN_HEADER);
+	void *ptr = alloc_small(size_class(size));
+	if (!ptr)
+		errno = ENOMEM;
+	return ptr;
+}
+
+void *malloc(size_t size) {
+	return allocate(size);
+}
+
+void free(void *ptr) {
+	if (!ptr)
+		return;
+
+	struct Span *span = span_of(ptr);
+	if (span->cls < 0)
+		munmap(span, span->length);
+	else
+		free_small(block_start(ptr, span->cls), span->cls);
+}
+
+size_t malloc_usable_size(void *ptr) {
+	if (!ptr)
+		return 0;
+
+	struct Span *span = span_of(ptr);
+	if (span->cls < 0)
+		return (char *) span + span->length - (char *) ptr;
+	return (char *) block_start(ptr, span->cls) + class_size(span->cls) - (char *) ptr;
+}
+
+void *calloc(size_t count, size_t size) {
+	if (size && count > SIZE_MAX / size) {
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	// Large blocks are fresh mappings
+	size_t total = count * size;
+	void *ptr = allocate(total);
+	if (ptr && total <= MAX_SMALL)
+		memset(ptr, 0, total);
+	return ptr;
+}
+
+void *realloc(void *ptr, size_t size) {
+	if (!ptr)
+		return malloc(size);
+	if (!size) {
+		free(ptr);
+		return NULL;
+	}
+
+	size_t usable = malloc_usable_size(ptr);
+	if (size <= usable && (size > MAX_SMALL || size_class(size) == span_of(ptr)->cls))
+		return ptr;
+
+	void *result = malloc(size);
+	if (result) {
+		memcpy(result, ptr, size < usable ? size : usable);
+		free(ptr);
+	}
+	return result;
+}
+
+// Alignments up to half a span
+void *memalign(size_t alignment, size_t size) {
+	if (alignment <= 16)
+		return malloc(size);
+	if (alignment > SPAN_SIZE / 2 || (alignment & (alignment - 1))) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	if (size + alignment > MAX_SMALL)
+		return alloc_large(size, alignment > SPAN_HEADER ? alignment : SPAN_HEADER);
+
+	char *ptr = (char *) malloc(size + alignment);
+	if (!ptr)
+		return NULL;
+	return (void *) (((uintptr_t) ptr + alignment - 1) & ~(uintptr_t) (alignment - 1));
+}
+
+void *aligned_alloc(size_t alignment, size_t size) {
+	return memalign(alignment, size);
+}
+
+int posix_memalign(void **ptr, size_t alignment, size_t size) {
+	if (alignment % sizeof(void *) || (alignment & (alignment - 1)))
+		return EINVAL;
+	void *result = memalign(alignment, size);
+	if (!result)
+		return errno;
+	*ptr = result;
+	return 0;
+}
+
+void *valloc(size_t size) {
+	return memalign(sysconf(_SC_PAGESIZE), size);
+}
+
+void *pvalloc(size_t size) {
+	size_t page = sysconf(_SC_PAGESIZE);
+	return memalign(page, (size + page - 1) & ~(page - 1));
+}
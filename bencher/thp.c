@@ -0,0 +1,22 @@
+// Huge page shim, preloaded by "bencher -thp on" (see thp.h). Advises huge
+// pages for large private anonymous mappings, which covers allocators other
+// than glibc's malloc and programs mapping memory themselves.
+#define _GNU_SOURCE
+
+#include <unistd.h>
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#define HUGE_PAGE (2 * 1024 * 1024)
+
+void *mmap(void *addr, size_t length, int prot, int flags, int fd, off_t offset) {
+#ifdef SYS_mmap2
+	void *ptr = (void *) syscall(SYS_mmap2, addr, length, prot, flags, fd, offset >> 12);
+#else
+	void *ptr = (void *) syscall(SYS_mmap, addr, length, prot, flags, fd, offset);
+#endif
+	if (ptr != MAP_FAILED && (flags & MAP_ANONYMOUS) && (flags & MAP_PRIVATE) && length >= HUGE_PAGE)
+		madvise(ptr, length, MADV_HUGEPAGE);
+	return ptr;
+}
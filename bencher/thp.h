@@ -0,0 +1,89 @@
+#ifndef _THP_H
+#define _THP_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sys/prctl.h>
+
+#include "allocstat.h"
+
+// Transparent huge pages for the benchmark: "off" disables them with prctl
+// (inherited across execv), "on" makes glibc's malloc advise huge pages for
+// its heaps (glibc.malloc.hugetlb tunable, glibc 2.35 and later) and preloads
+// output/thp.so, which advises all other large anonymous mappings. "default"
+// leaves the system setting alone.
+
+#ifndef THP_SHIM
+    #define THP_SHIM "output/thp.so"
+#endif
+#define THP_SETTING "/sys/kernel/mm/transparent_hugepage/enabled"
+
+enum ThpMode { THP_DEFAULT, THP_ON, THP_OFF };
+const char *thp_names[] = { "default", "on", "off" };
+
+// Mode by name, -1 if unknown
+int thp_mode(const char *name) {
+    for (int i = 0; i < (int) (sizeof thp_names / sizeof *thp_names); ++i)
+        if (strcmp(name, thp_names[i]) == 0)
+            return i;
+    return -1;
+}
+
+// Warn once if huge pages can't be used at all
+void thp_check(void) {
+    static int checked;
+    if (checked)
+        return;
+    checked = 1;
+
+    char setting[64] = "";
+    FILE *file = fopen(THP_SETTING, "r");
+    if (file) {
+        if (!fgets(setting, sizeof setting, file))
+            setting[0] = 0;
+        fclose(file);
+    }
+    if (!strstr(setting, "[always]") && !strstr(setting, "[madvise]"))
+        fprintf(stderr, "Warning: Transparent huge pages are disabled (%s), \"-thp on\" has no effect.\n", THP_SETTING);
+}
+
+// Apply mode to the calling process (in the child, before execv)
+void thp_child(int mode) {
+    if (mode == THP_OFF) {
+        prctl(PR_SET_THP_DISABLE, 1, 0, 0, 0);
+    } else if (mode == THP_ON) {
+        const char *tunables = getenv("GLIBC_TUNABLES");
+        const char *hugetlb = "glibc.malloc.hugetlb=1";
+        if (tunables && *tunables) {
+            char *both = (char *) malloc(strlen(tunables) + strlen(hugetlb) + 2);
+            sprintf(both, "%s:%s", tunables, hugetlb);
+            setenv("GLIBC_TUNABLES", both, 1);
+            free(both);
+        } else {
+            setenv("GLIBC_TUNABLES", hugetlb, 1);
+        }
+        preload_library(THP_SHIM);
+    }
+}
+
+// Huge pages allocated on page faults so far (system wide), -1 if unknown
+long thp_faults(void) {
+    FILE *file = fopen("/proc/vmstat", "r");
+    if (!file)
+        return -1;
+
+    long faults = -1;
+    char *line = NULL;
+    size_t len = 0;
+    while (faults < 0 && getline(&line, &len, file) > 0)
+        if (sscanf(line, "thp_fault_alloc %ld", &faults) != 1)
+            faults = -1;
+
+    free(line);
+    fclose(file);
+    return faults;
+}
+
+#endif // _THP_H
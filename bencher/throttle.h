@@ -0,0 +1,175 @@
+#ifndef _THROTTLE_H
+#define _THROTTLE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sched.h>
+#include <pthread.h>
+
+#include "cpufreq.h"
+#include "affinity.h"
+
+// Frequency of the benchmark cpus and temperature of all thermal zones,
+// sampled by a separate thread while the child is running. The governor is
+// only checked once before the first run, this catches thermal throttling.
+
+#ifndef THERMAL_DIR
+    #define THERMAL_DIR "/sys/class/thermal"
+#endif
+#define THERMAL_ZONE THERMAL_DIR "/%s/temp"
+#define THROTTLE_INTERVAL_MS 50
+#define THROTTLE_FILES 64
+
+// Results of a single run
+struct Clocks {
+    int freq_samples;
+    long min_freq;   // kHz
+    double avg_freq; // kHz
+    int temp_samples;
+    long max_temp;   // millidegrees Celsius
+};
+
+struct Throttle {
+    pthread_t thread;
+    int stop[2]; // closed by the parent to stop sampling
+    const cpu_set_t *cpus;
+    struct Clocks *clocks;
+
+    int freq_fds[THROTTLE_FILES], freq_count;
+    int temp_fds[THROTTLE_FILES], temp_count;
+};
+
+// Re-read a sysfs value from an open file, returns 0 on error
+int read_sysfs_long(int fd, long *value) {
+    char buffer[32];
+    ssize_t read_bytes = pread(fd, buffer, sizeof buffer - 1, 0);
+    if (read_bytes <= 0)
+        return 0;
+
+    buffer[read_bytes] = 0;
+    *value = atol(buffer);
+    return 1;
+}
+
+// Open scaling_cur_freq of the benchmark cpus and all thermal zones
+void throttle_open(struct Throttle *throttle) {
+    throttle->freq_count = 0;
+    for (int cpu = 0; cpu < CPU_SETSIZE && throttle->freq_count < THROTTLE_FILES; ++cpu) {
+        if (!CPU_ISSET(cpu, throttle->cpus))
+            continue;
+
+        // Enough room to print any int (warns for lower numbers)
+        char filename[sizeof CURRENT_FREQUENCY + 8];
+        snprintf(filename, sizeof filename, CURRENT_FREQUENCY, cpu);
+        int fd = open(filename, O_RDONLY | O_CLOEXEC);
+        if (fd >= 0)
+            throttle->freq_fds[throttle->freq_count++] = fd;
+    }
+
+    throttle->temp_count = 0;
+    DIR *dir = opendir(THERMAL_DIR);
+    struct dirent *entry;
+    while (dir && (entry = readdir(dir)) && throttle->temp_count < THROTTLE_FILES) {
+        if (strncmp(entry->d_name, "thermal_zone", 12) != 0)
+            continue;
+
+        char filename[sizeof THERMAL_ZONE + sizeof entry->d_name];
+        snprintf(filename, sizeof filename, THERMAL_ZONE, entry->d_name);
+        int fd = open(filename, O_RDONLY | O_CLOEXEC);
+        if (fd >= 0)
+            throttle->temp_fds[throttle->temp_count++] = fd;
+    }
+    if (dir)
+        closedir(dir);
+}
+
+void throttle_sample(struct Throttle *throttle) {
+    struct Clocks *clocks = throttle->clocks;
+    long value;
+
+    for (int i = 0; i < throttle->freq_count; ++i) {
+        if (!read_sysfs_long(throttle->freq_fds[i], &value))
+            continue;
+
+        if (!clocks->freq_samples || value < clocks->min_freq)
+            clocks->min_freq = value;
+        clocks->avg_freq += value; // Sum until throttle_finish
+        ++clocks->freq_samples;
+    }
+
+    for (int i = 0; i < throttle->temp_count; ++i) {
+        if (!read_sysfs_long(throttle->temp_fds[i], &value))
+            continue;
+
+        if (!clocks->temp_samples || value > clocks->max_temp)
+            clocks->max_temp = value;
+        ++clocks->temp_samples;
+    }
+}
+
+void *throttle_main(void *arg) {
+    struct Throttle *throttle = (struct Throttle *) arg;
+    throttle_open(throttle);
+
+    // Sample at least once at the start and once at the end
+    struct pollfd stop = { throttle->stop[0], POLLIN, 0 };
+    do {
+        throttle_sample(throttle);
+    } while (poll(&stop, 1, THROTTLE_INTERVAL_MS) == 0);
+    throttle_sample(throttle);
+
+    for (int i = 0; i < throttle->freq_count; ++i)
+        close(throttle->freq_fds[i]);
+    for (int i = 0; i < throttle->temp_count; ++i)
+        close(throttle->temp_fds[i]);
+    return NULL;
+}
+
+// Start sampling until throttle_finish. The thread avoids the benchmark cpus
+// if there are any others.
+int throttle_start(struct Throttle *throttle, const cpu_set_t *benchmark_cpus, struct Clocks *clocks) {
+    memset(clocks, 0, sizeof *clocks);
+    throttle->cpus = benchmark_cpus;
+    throttle->clocks = clocks;
+
+    if (pipe2(throttle->stop, O_CLOEXEC)) {
+        perror("pipe throttle");
+        return 0;
+    }
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+
+    cpu_set_t others;
+    if (other_cpus(benchmark_cpus, &others))
+        pthread_attr_setaffinity_np(&attr, sizeof others, &others);
+
+    int result = pthread_create(&throttle->thread, &attr, throttle_main, throttle);
+    pthread_attr_destroy(&attr);
+    if (result) {
+        fprintf(stderr, "Error: Could not start frequency thread.\n");
+        close(throttle->stop[0]);
+        close(throttle->stop[1]);
+        return 0;
+    }
+
+    return 1;
+}
+
+// Stop sampling and average the frequency samples
+void throttle_finish(struct Throttle *throttle) {
+    close(throttle->stop[1]);
+    pthread_join(throttle->thread, NULL);
+    close(throttle->stop[0]);
+
+    struct Clocks *clocks = throttle->clocks;
+    if (clocks->freq_samples)
+        clocks->avg_freq /= clocks->freq_samples;
+}
+
+#endif // _THROTTLE_H
@@ -0,0 +1,78 @@
+#ifndef _TIMING_H
+#define _TIMING_H
+
+#include <stdio.h>
+#include <time.h>
+#include <poll.h>
+#include <unistd.h>
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#define CLOCK CLOCK_MONOTONIC
+
+// Timestamps of a single run, fork and exec are written by the child into a
+// page shared with the parent
+struct Stamps {
+    struct timespec fork;   // parent, before fork
+    struct timespec exec;   // child, just before execv
+    struct timespec exit;   // parent, when the child has exited
+    struct timespec reaped; // parent, after wait4
+};
+
+struct Stamps *stamps_create() {
+    struct Stamps *stamps = (struct Stamps *) mmap(NULL, sizeof(struct Stamps), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (stamps == MAP_FAILED) {
+        perror("mmap stamps");
+        return NULL;
+    }
+    return stamps;
+}
+
+void stamps_free(struct Stamps *stamps) {
+    munmap(stamps, sizeof(struct Stamps));
+}
+
+struct timespec time_diff(const struct timespec *end, const struct timespec *start) {
+    struct timespec result = { end->tv_sec - start->tv_sec, end->tv_nsec - start->tv_nsec };
+
+    // Manually carry
+    if (result.tv_nsec < 0) {
+        result.tv_nsec += 1000000000;
+        --result.tv_sec;
+    }
+    return result;
+}
+
+struct timespec time_add(const struct timespec *a, const struct timespec *b) {
+    struct timespec result = { a->tv_sec + b->tv_sec, a->tv_nsec + b->tv_nsec };
+    if (result.tv_nsec >= 1000000000) {
+        result.tv_nsec -= 1000000000;
+        ++result.tv_sec;
+    }
+    return result;
+}
+
+// File descriptor which becomes readable when pid exits, -1 if not supported
+int pidfd_open(pid_t pid) {
+#ifdef SYS_pidfd_open
+    return syscall(SYS_pidfd_open, pid, 0);
+#else
+    (void) pid;
+    return -1;
+#endif
+}
+
+// Block until the child has exited (without reaping it) and store the time.
+// Without pidfd support, the exit time is taken after reaping.
+void wait_exit(int pidfd, struct timespec *exit) {
+    if (pidfd < 0)
+        return;
+
+    struct pollfd fd = { pidfd, POLLIN, 0 };
+    while (poll(&fd, 1, -1) < 0);
+    clock_gettime(CLOCK, exit);
+    close(pidfd);
+}
+
+#endif // _TIMING_H
@@ -10,6 +10,8 @@
 #include <future>
 #include <unistd.h>
 
+#include "../harness.hpp"
+
 typedef unsigned char int_t;
 
 void rotate(int_t* p, int n)
@@ -132,6 +134,7 @@ int main(int argc, char** argv)
       printf("n should be between [3 and 12]\n");
       return 0;
    }
+   harness::measure("fannkuch", [&]{ return fannkuch(n); });
    Result r = fannkuch(n);
    printf("%d\nPfannkuchen(%d) = %d\n",r.checksum,n,r.maxflips);
 }
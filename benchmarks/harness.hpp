@@ -0,0 +1,79 @@
+// Steady-state harness for the C++ programs. Compiled with -DHARNESS,
+// harness::measure calls the core routine of a program repeatedly in one
+// process, after startup, dynamic loading and with warm caches. Programs
+// call it before their own (unchanged) call of the routine, without HARNESS
+// it does nothing.
+//
+// Each measure writes one line to the file descriptor in BENCHER_HARNESS_FD
+// (set by "bencher -harness", same name as in bencher/harness.h), or to
+// stderr:
+//   <name> <calls> <first-ns> <median-ns> <min-ns>
+// The first call is not part of median and minimum. HARNESS_CALLS sets the
+// number of calls (default 5, at least 2).
+#ifndef HARNESS_HPP
+#define HARNESS_HPP
+
+#include <string>
+
+#ifdef HARNESS
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <type_traits>
+#include <vector>
+#include <unistd.h>
+
+namespace harness {
+
+// Keep the result of a call from being optimized away
+template <typename T>
+inline void keep(T& value) {
+    asm volatile("" : : "g"(&value) : "memory");
+}
+
+template <typename F>
+void measure(const std::string& name, F&& call) {
+    const char* setting = std::getenv("HARNESS_CALLS");
+    long calls = std::max(setting ? std::atol(setting) : 5l, 2l);
+
+    std::vector<long long> times;
+    for (long i = 0; i < calls; ++i) {
+        auto start = std::chrono::steady_clock::now();
+        if constexpr (std::is_void_v<decltype(call())>) {
+            call();
+        } else {
+            auto result = call();
+            keep(result);
+        }
+        auto end = std::chrono::steady_clock::now();
+        times.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+    }
+
+    // Warm calls only
+    std::sort(times.begin() + 1, times.end());
+    long long median = times[1 + (times.size() - 2) / 2];
+
+    const char* fd_setting = std::getenv("BENCHER_HARNESS_FD");
+    int fd = fd_setting ? std::atoi(fd_setting) : STDERR_FILENO;
+    char line[256];
+    int length = std::snprintf(line, sizeof line, "%s %ld %lld %lld %lld\n", name.c_str(), calls, times[0], median, times[1]);
+    if (write(fd, line, std::min<size_t>(length, sizeof line - 1)) < 0)
+        std::perror("harness");
+}
+
+} // namespace harness
+
+#else
+
+namespace harness {
+
+template <typename F>
+inline void measure(const std::string&, F&&) {}
+
+} // namespace harness
+
+#endif // HARNESS
+
+#endif // HARNESS_HPP
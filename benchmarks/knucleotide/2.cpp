@@ -41,6 +41,8 @@
 #include <cassert>
 #include <ext/pb_ds/assoc_container.hpp>
 
+#include "../harness.hpp"
+
 struct Cfg {
     static constexpr size_t thread_count = 4;
     static constexpr unsigned to_char[4] = {'A', 'C', 'T', 'G'};
@@ -173,6 +175,7 @@ auto CalculateInThreads(const Cfg::Data& input)
 template <unsigned size>
 void WriteFrequencies(const Cfg::Data& input)
 {
+    harness::measure("CalculateInThreads<" + std::to_string(size) + ">", [&]{ return CalculateInThreads<size>(input).size(); });
     // we "receive" the returned object by move instead of copy.
     auto&& frequencies = CalculateInThreads<size>(input);
     std::map<unsigned, std::string, std::greater<unsigned>> freq;
@@ -187,6 +190,7 @@ void WriteFrequencies(const Cfg::Data& input)
 
 template <unsigned size>
 void WriteCount( const Cfg::Data& input, const std::string& text ) {
+    harness::measure("CalculateInThreads<" + std::to_string(size) + ">", [&]{ return CalculateInThreads<size>(input).size(); });
     // we "receive" the returned object by move instead of copy.
     auto&& frequencies = CalculateInThreads<size>(input);
     std::cout << frequencies[Key<size>(text)] << '\t' << text << '\n';
@@ -13,6 +13,8 @@
 #include <iostream>
 #include <iomanip>
 
+#include "../harness.hpp"
+
 using namespace std;
 
 double eval_A(int i, int j) { return 1.0 / ((i+j)*(i+j+1)/2 + i + 1); }
@@ -39,6 +41,8 @@ int main(int argc, char *argv[])
 
   fill(u.begin(), u.end(), 1);
 
+  harness::measure("eval_AtA_times_u", [&]{ vector<double> w(N); eval_AtA_times_u(u, w); return w[0]; });
+
   for(int i=0; i<10; i++) {
     eval_AtA_times_u(u, v);
     fill(u.begin(), u.end(), 0);
@@ -0,0 +1,121 @@
+# Generated by script/manifest-rules.awk from benchmarks/campaign.manifest, do not edit
+
+# fannkuch
+FANNKUCH := 12
+MANIFEST_SIZES += fannkuch=$(FANNKUCH)
+output/fannkuch-%.txt: benchmarks/fannkuch/1.c.run
+	@mkdir -p output
+	./benchmarks/fannkuch/1.c.run $* > $@
+.SECONDARY: output/fannkuch-$(FANNKUCH).txt output/fannkuch-$(FANNKUCH).txt.digest $(SWEEP_FANNKUCH:%=output/fannkuch-%.txt) $(SWEEP_FANNKUCH:%=output/fannkuch-%.txt.digest)
+benchmarks/fannkuch/%: SIZE = $(FANNKUCH)
+benchmarks/fannkuch/%: SWEEP = $(SWEEP_FANNKUCH)
+benchmarks/fannkuch/%: DEPENDS = output/fannkuch-$(SIZE).txt output/fannkuch-$(SIZE).txt.digest
+benchmarks/fannkuch/%: BENCH = $(BENCHER) -digest output/fannkuch-$(SIZE).txt.digest $(BM_OUT) $(BINARY) $(SIZE)
+
+# fasta
+FASTA := 25000000
+MANIFEST_SIZES += fasta=$(FASTA)
+output/fasta-%.txt: benchmarks/fasta/1.c.run
+	@mkdir -p output
+	./benchmarks/fasta/1.c.run $* > $@
+.SECONDARY: output/fasta-$(FASTA).txt output/fasta-$(FASTA).txt.digest $(SWEEP_FASTA:%=output/fasta-%.txt) $(SWEEP_FASTA:%=output/fasta-%.txt.digest)
+benchmarks/fasta/%: SIZE = $(FASTA)
+benchmarks/fasta/%: SWEEP = $(SWEEP_FASTA)
+benchmarks/fasta/%: DEPENDS = output/fasta-$(SIZE).txt output/fasta-$(SIZE).txt.digest
+benchmarks/fasta/%: BENCH = $(BENCHER) -digest output/fasta-$(SIZE).txt.digest $(BM_OUT) $(BINARY) $(SIZE)
+
+# knucleotide
+KNUCLEOTIDE := 25000000
+MANIFEST_SIZES += knucleotide=$(KNUCLEOTIDE)
+output/knucleotide-%.txt: benchmarks/knucleotide/1.cpp.run output/fasta-%.txt
+	@mkdir -p output
+	./benchmarks/knucleotide/1.cpp.run 0 < output/fasta-$*.txt > $@
+.SECONDARY: output/fasta-$(KNUCLEOTIDE).txt output/knucleotide-$(KNUCLEOTIDE).txt output/knucleotide-$(KNUCLEOTIDE).txt.digest $(SWEEP_KNUCLEOTIDE:%=output/fasta-%.txt) $(SWEEP_KNUCLEOTIDE:%=output/knucleotide-%.txt) $(SWEEP_KNUCLEOTIDE:%=output/knucleotide-%.txt.digest)
+benchmarks/knucleotide/%: SIZE = $(KNUCLEOTIDE)
+benchmarks/knucleotide/%: SWEEP = $(SWEEP_KNUCLEOTIDE)
+benchmarks/knucleotide/%: DEPENDS = output/fasta-$(SIZE).txt output/knucleotide-$(SIZE).txt output/knucleotide-$(SIZE).txt.digest
+benchmarks/knucleotide/%: BENCH = $(BENCHER) -i output/fasta-$(SIZE).txt -digest output/knucleotide-$(SIZE).txt.digest $(BM_OUT) $(BINARY) 0
+
+# mandelbrot
+MANDELBROT := 16000
+MANIFEST_SIZES += mandelbrot=$(MANDELBROT)
+output/mandelbrot-%.pbm: benchmarks/mandelbrot/2.c.run
+	@mkdir -p output
+	./benchmarks/mandelbrot/2.c.run $* > $@
+.SECONDARY: output/mandelbrot-$(MANDELBROT).pbm output/mandelbrot-$(MANDELBROT).pbm.digest $(SWEEP_MANDELBROT:%=output/mandelbrot-%.pbm) $(SWEEP_MANDELBROT:%=output/mandelbrot-%.pbm.digest)
+benchmarks/mandelbrot/%: SIZE = $(MANDELBROT)
+benchmarks/mandelbrot/%: SWEEP = $(SWEEP_MANDELBROT)
+benchmarks/mandelbrot/%: DEPENDS = output/mandelbrot-$(SIZE).pbm output/mandelbrot-$(SIZE).pbm.digest
+benchmarks/mandelbrot/%: BENCH = $(BENCHER) -digest output/mandelbrot-$(SIZE).pbm.digest -bin $(BM_OUT) $(BINARY) $(SIZE)
+
+# nbody
+NBODY := 50000000
+MANIFEST_SIZES += nbody=$(NBODY)
+output/nbody-%.txt: benchmarks/nbody/1.c.run
+	@mkdir -p output
+	./benchmarks/nbody/1.c.run $* > $@
+.SECONDARY: output/nbody-$(NBODY).txt $(SWEEP_NBODY:%=output/nbody-%.txt)
+benchmarks/nbody/%: SIZE = $(NBODY)
+benchmarks/nbody/%: SWEEP = $(SWEEP_NBODY)
+benchmarks/nbody/%: DEPENDS = output/nbody-$(SIZE).txt
+benchmarks/nbody/%: BENCH = $(BENCHER) -diff output/nbody-$(SIZE).txt -abserr 1.0e-8 $(BM_OUT) $(BINARY) $(SIZE)
+
+# pi
+PI := 10000
+MANIFEST_SIZES += pi=$(PI)
+output/pi-%.txt: benchmarks/pi/1.c.run
+	@mkdir -p output
+	./benchmarks/pi/1.c.run $* > $@
+.SECONDARY: output/pi-$(PI).txt output/pi-$(PI).txt.digest $(SWEEP_PI:%=output/pi-%.txt) $(SWEEP_PI:%=output/pi-%.txt.digest)
+benchmarks/pi/%: SIZE = $(PI)
+benchmarks/pi/%: SWEEP = $(SWEEP_PI)
+benchmarks/pi/%: DEPENDS = output/pi-$(SIZE).txt output/pi-$(SIZE).txt.digest
+benchmarks/pi/%: BENCH = $(BENCHER) -digest output/pi-$(SIZE).txt.digest $(BM_OUT) $(BINARY) $(SIZE)
+
+# regex
+REGEX := 5000000
+MANIFEST_SIZES += regex=$(REGEX)
+output/regex-%.txt: benchmarks/regex/2.c.run output/fasta-%.txt
+	@mkdir -p output
+	./benchmarks/regex/2.c.run 0 < output/fasta-$*.txt > $@
+.SECONDARY: output/fasta-$(REGEX).txt output/regex-$(REGEX).txt output/regex-$(REGEX).txt.digest $(SWEEP_REGEX:%=output/fasta-%.txt) $(SWEEP_REGEX:%=output/regex-%.txt) $(SWEEP_REGEX:%=output/regex-%.txt.digest)
+benchmarks/regex/%: SIZE = $(REGEX)
+benchmarks/regex/%: SWEEP = $(SWEEP_REGEX)
+benchmarks/regex/%: DEPENDS = output/fasta-$(SIZE).txt output/regex-$(SIZE).txt output/regex-$(SIZE).txt.digest
+benchmarks/regex/%: BENCH = $(BENCHER) -i output/fasta-$(SIZE).txt -digest output/regex-$(SIZE).txt.digest $(BM_OUT) $(BINARY) 0
+
+# revcomp
+REVCOMP := 25000000
+MANIFEST_SIZES += revcomp=$(REVCOMP)
+output/revcomp-%.txt: benchmarks/revcomp/1.cpp.run output/fasta-%.txt
+	@mkdir -p output
+	./benchmarks/revcomp/1.cpp.run 0 < output/fasta-$*.txt > $@
+.SECONDARY: output/fasta-$(REVCOMP).txt output/revcomp-$(REVCOMP).txt output/revcomp-$(REVCOMP).txt.digest $(SWEEP_REVCOMP:%=output/fasta-%.txt) $(SWEEP_REVCOMP:%=output/revcomp-%.txt) $(SWEEP_REVCOMP:%=output/revcomp-%.txt.digest)
+benchmarks/revcomp/%: SIZE = $(REVCOMP)
+benchmarks/revcomp/%: SWEEP = $(SWEEP_REVCOMP)
+benchmarks/revcomp/%: DEPENDS = output/fasta-$(SIZE).txt output/revcomp-$(SIZE).txt output/revcomp-$(SIZE).txt.digest
+benchmarks/revcomp/%: BENCH = $(BENCHER) -i output/fasta-$(SIZE).txt -digest output/revcomp-$(SIZE).txt.digest $(BM_OUT) $(BINARY) 0
+
+# spectral
+SPECTRAL := 5500
+MANIFEST_SIZES += spectral=$(SPECTRAL)
+output/spectral-%.txt: benchmarks/spectral/1.c.run
+	@mkdir -p output
+	./benchmarks/spectral/1.c.run $* > $@
+.SECONDARY: output/spectral-$(SPECTRAL).txt output/spectral-$(SPECTRAL).txt.digest $(SWEEP_SPECTRAL:%=output/spectral-%.txt) $(SWEEP_SPECTRAL:%=output/spectral-%.txt.digest)
+benchmarks/spectral/%: SIZE = $(SPECTRAL)
+benchmarks/spectral/%: SWEEP = $(SWEEP_SPECTRAL)
+benchmarks/spectral/%: DEPENDS = output/spectral-$(SIZE).txt output/spectral-$(SIZE).txt.digest
+benchmarks/spectral/%: BENCH = $(BENCHER) -digest output/spectral-$(SIZE).txt.digest $(BM_OUT) $(BINARY) $(SIZE)
+
+# trees
+TREES := 21
+MANIFEST_SIZES += trees=$(TREES)
+output/trees-%.txt: benchmarks/trees/1.c.run
+	@mkdir -p output
+	./benchmarks/trees/1.c.run $* > $@
+.SECONDARY: output/trees-$(TREES).txt output/trees-$(TREES).txt.digest $(SWEEP_TREES:%=output/trees-%.txt) $(SWEEP_TREES:%=output/trees-%.txt.digest)
+benchmarks/trees/%: SIZE = $(TREES)
+benchmarks/trees/%: SWEEP = $(SWEEP_TREES)
+benchmarks/trees/%: DEPENDS = output/trees-$(SIZE).txt output/trees-$(SIZE).txt.digest
+benchmarks/trees/%: BENCH = $(BENCHER) -digest output/trees-$(SIZE).txt.digest $(BM_OUT) $(BINARY) $(SIZE)
@@ -0,0 +1,88 @@
+# Generate the per type settings and rules of the Makefile from a campaign
+# manifest (see bencher/manifest.h), so both run the same references, inputs
+# and diff modes:
+#   <NAME> := <size>                     default size, overridable by make
+#   output/<reference>: <program> [<input reference>]
+#                                        creates the reference
+#   benchmarks/<name>/%: SIZE, SWEEP, DEPENDS and BENCH
+# Sweep sizes are taken from SWEEP_<NAME> in the Makefile.
+#
+# Usage: awk -f script/manifest-rules.awk <manifest-file> > <makefile>
+
+# Text after the first n words of the current line
+function rest(n,    text) {
+    text = $0
+    sub(/^[ \t]+/, "", text)
+    while (n-- > 0)
+        sub(/^[^ \t]+[ \t]*/, "", text)
+    return text
+}
+
+# Replace every "{}" by replacement
+function size(text, replacement) {
+    gsub(/\{\}/, replacement, text)
+    return text
+}
+
+{ sub(/[ \t\r]+$/, "") }
+/^[ \t]*(#|$)/ { next }
+
+$1 == "type" {
+    type = $2
+    types[++count] = type
+    sizes[type] = $3
+    next
+}
+$1 == "input" { input[type] = $2; next }
+$1 == "reference" { reference[type] = $2; command[type] = rest(2); next }
+$1 == "diff" { digest[type] = $2 == "digest"; diff[type] = rest(2); next }
+$1 == "args" { args[type] = rest(1); next }
+
+END {
+    print "# Generated by script/manifest-rules.awk from " FILENAME ", do not edit"
+    for (i = 1; i <= count; ++i) {
+        type = types[i]
+        var = toupper(type)
+        ref = reference[type]
+        stdin = type in input ? reference[input[type]] : ""
+        program = command[type]
+        sub(/[ \t].*/, "", program)
+        sub(/^\.\//, "", program)
+
+        # Files of a run, as a pattern with {} for the size
+        files = (stdin != "" ? stdin " " : "") ref (digest[type] ? " " ref ".digest" : "")
+        count_files = split(files, list, " ")
+
+        print ""
+        print "# " type
+        print var " := " sizes[type]
+        print "MANIFEST_SIZES += " type "=$(" var ")"
+
+        # Reference, created with the input on stdin
+        print size(ref, "%") ": " program (stdin != "" ? " " size(stdin, "%") : "")
+        print "\t@mkdir -p output"
+        print "\t" size(command[type], "$*") (stdin != "" ? " < " size(stdin, "$*") : "") " > $@"
+
+        secondary = ""
+        for (j = 1; j <= count_files; ++j)
+            secondary = secondary " " size(list[j], "$(" var ")")
+        for (j = 1; j <= count_files; ++j)
+            secondary = secondary " $(SWEEP_" var ":%=" size(list[j], "%") ")"
+        print ".SECONDARY:" secondary
+
+        bench = "$(BENCHER)"
+        if (stdin != "")
+            bench = bench " -i " size(stdin, "$(SIZE)")
+        bench = bench (digest[type] ? " -digest " size(ref, "$(SIZE)") ".digest" : " -diff " size(ref, "$(SIZE)"))
+        if (diff[type] != "")
+            bench = bench " " diff[type]
+        bench = bench " $(BM_OUT) $(BINARY)"
+        if (args[type] != "")
+            bench = bench " " size(args[type], "$(SIZE)")
+
+        print "benchmarks/" type "/%: SIZE = $(" var ")"
+        print "benchmarks/" type "/%: SWEEP = $(SWEEP_" var ")"
+        print "benchmarks/" type "/%: DEPENDS = " size(files, "$(SIZE)")
+        print "benchmarks/" type "/%: BENCH = " bench
+    }
+}